@@ -1,283 +1,315 @@
-#include <pthread.h>
-#include <sys/mman.h>  // necessary for mlockall
-#include <sys/time.h>
+#include <atomic>
 #include <cstring>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <vector>
+#include "p3_experiment.h"
+#include "p3_metrics.h"
+#include "p3_pipeline.h"
+#include "p3_preflight.h"
+#include "p3_steal.h"
+#include "p3_sweep.h"
+#include "p3_thermal.h"
+#include "p3_thread.h"
+#include "p3_timing.h"
 #include "p3_util.h"
+#include "p3_workload.h"
 
-#define SET_CPU false
+class AppTypeX : public ThreadRT {
+public:
+    AppTypeX(int app_id, int priority, int policy, const ThreadSpec& spec)
+        : ThreadRT(app_id, priority, policy), name_(spec.workload), workload_(MakeWorkload(spec)),
+          units_(FindWorkload(spec.workload)->run_units) {}
 
-void LockMemory() {
-    int ret = mlockall(MCL_CURRENT | MCL_FUTURE);
-    if (ret) {
-        throw std::runtime_error{std::string("mlockall failed: ") + std::strerror(errno)};
+    void Run() {
+        printf("Running App #%d (%s)...\n", app_id_, name_.c_str());
+        if (!RunWorkload(workload_.get(), units_)) printf("App #%d: %s setup failed\n", app_id_, name_.c_str());
     }
-}
 
-void setCPU(int cpu_id = 1) {
-    // Set CPU affinity
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(cpu_id, &cpuset);
-    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
-}
-
-class ThreadRT {
-    int priority_;
-    int policy_;
-    pthread_t thread_;
-    struct timeval start_time;
-
-    static void* RunThreadRT(void* data) {
-        #if SET_CPU
-        setCPU(1);  // Ensure thread is bound to CPU 1
-    #endif
-    
-        // Print which CPU the RT thread is running on
-        printf("[RT thread #%lu] running on CPU #%d\n", pthread_self(), sched_getcpu());
-    
-        // Get the thread's scheduling parameters (policy and priority)
-        sched_param param;
-        int policy;
-        int ret = pthread_getschedparam(pthread_self(), &policy, &param);
-        if (ret == 0) {
-            printf("[RT thread #%lu] Scheduling policy: ");
-            if (policy == SCHED_FIFO) {
-                printf("SCHED_FIFO ");
-            } else if (policy == SCHED_RR) {
-                printf("SCHED_RR ");
-            } else {
-                printf("Other policy ");
-            }
-            printf("with priority %d\n", param.sched_priority);
-        } else {
-            printf("[RT thread #%lu] Failed to get scheduling parameters\n", pthread_self());
-        }
-    
-        // Run the thread's workload
-        ThreadRT* thread = static_cast<ThreadRT*>(data);
-        thread->Run();
-        return NULL;
+    // In periodic mode, one workload step (one CannyP3 frame, one BusyCal,
+    // one pass) per period
+    bool Setup() {
+        printf("Running App #%d (periodic %s)...\n", app_id_, name_.c_str());
+        return workload_->Setup();
     }
 
-public:
-    int app_id_;
+    bool Cycle(int /*cycle*/) { return workload_->Step(); }
+
+    void Teardown() { workload_->Teardown(); }
 
-    ThreadRT(int app_id, int priority, int policy) : app_id_(app_id), priority_(priority), policy_(policy) {}
+    void Degrade(bool on) { workload_->SetDegraded(on); }
 
-    void Start() {
-        // Initialize pthread attributes
-        pthread_attr_t thread_attr;
-        pthread_attr_init(&thread_attr);
+private:
+    std::string name_;
+    std::unique_ptr<Workload> workload_;
+    int units_;
+};
 
-        // Set the scheduling policy (e.g., SCHED_FIFO or SCHED_RR)
-        pthread_attr_setschedpolicy(&thread_attr, policy_);
-        
-        // Set the thread's priority
-        sched_param param;
-        param.sched_priority = priority_;
-        pthread_attr_setschedparam(&thread_attr, &param);
+class AppTypeY : public ThreadNRT {
+public:
+    AppTypeY(int app_id, const ThreadSpec& spec)
+        : ThreadNRT(app_id), name_(spec.workload), workload_(MakeWorkload(spec)),
+          units_(FindWorkload(spec.workload)->run_units) {}
 
-        // Set the thread's stack size (optional, but often necessary for RT threads)
-        pthread_attr_setstacksize(&thread_attr, 1024 * 1024);  // 1MB stack size
+    void Run() {
+        printf("Running App #%d (%s)...\n", app_id_, name_.c_str());
+        if (!RunWorkload(workload_.get(), units_)) printf("App #%d: %s setup failed\n", app_id_, name_.c_str());
+    }
 
-        // Ensure the thread does not inherit attributes from the parent thread
-        pthread_attr_setinheritsched(&thread_attr, PTHREAD_EXPLICIT_SCHED);
+private:
+    std::string name_;
+    std::unique_ptr<Workload> workload_;
+    int units_;
+};
 
-        // Start the timer
-        gettimeofday(&start_time, NULL);
+// Background stress (class = stress): an NRT app that repeats its workload
+// from before the first app starts until Stop(), after the last one ends
+class AppTypeZ : public ThreadNRT {
+public:
+    AppTypeZ(int app_id, const ThreadSpec& spec) : ThreadNRT(app_id), name_(spec.workload), workload_(MakeWorkload(spec)) {}
 
-        // Create the RT thread
-        int ret = pthread_create(&thread_, &thread_attr, &ThreadRT::RunThreadRT, this);
-        if (ret) {
-            throw std::runtime_error{std::string("pthread_create failed: ") + std::strerror(ret)};
+    void Run() {
+        printf("Running App #%d (stress %s)...\n", app_id_, name_.c_str());
+        if (!workload_->Setup()) {
+            printf("App #%d: %s setup failed\n", app_id_, name_.c_str());
+            return;
         }
-
-        // Destroy the thread attribute object after the thread has been created
-        pthread_attr_destroy(&thread_attr);
+        long units = 0;
+        while (!stop_.load(std::memory_order_relaxed) && workload_->Step()) units++;
+        workload_->Teardown();
+        printf("App #%d stress: %ld %s units%s\n", app_id_, units, name_.c_str(),
+               stop_.load(std::memory_order_relaxed) ? "" : " (workload ended early)");
     }
 
-    void Join() {
-        // Wait for the thread to finish
-        int ret = pthread_join(thread_, NULL);
-        if (ret) {
-            throw std::runtime_error{std::string("pthread_join failed: ") + std::strerror(ret)};
-        }
+    // Ends the run after the current unit
+    void Stop() { stop_.store(true, std::memory_order_relaxed); }
 
-        // End the timer and calculate elapsed time
-        struct timeval end_time;
-        gettimeofday(&end_time, NULL);
+private:
+    std::string name_;
+    std::unique_ptr<Workload> workload_;
+    std::atomic<bool> stop_{false};
+};
 
-        long seconds = end_time.tv_sec - start_time.tv_sec;
-        long micros = (end_time.tv_usec - start_time.tv_usec);
-        double elapsed_time = seconds + micros * 1e-6;
-        printf("App #%d runtime: %f seconds\n", app_id_, elapsed_time);
+// Timeline row label, e.g. "App #1 RT canny"
+static std::string TraceName(const ThreadSpec& t) {
+    static const char* kinds[] = {" RT ", " NRT ", " stress "};
+    return "App #" + std::to_string(t.app_id) + kinds[t.cls] + t.workload;
+}
 
-        printf("[RT thread #%lu] App #%d Ends\n", thread_, app_id_);
+// Build every app of an experiment, lock memory, then start and join them in
+// app order; returns each app's results for the sweep harness
+std::vector<AppResult> RunExperiment(const ExperimentSpec& spec) {
+    if (!spec.description.empty()) printf("%s\n", spec.description.c_str());
+    if (spec.preflight != PREFLIGHT_OFF && RunPreflight(spec) > 0 && spec.preflight == PREFLIGHT_ENFORCE) {
+        throw std::runtime_error{"preflight = enforce and the host failed RT checks"};
     }
 
-    virtual void Run() = 0;
-};
-
-class ThreadNRT {
-    pthread_t thread_;
-    struct timeval start_time;
-
-    static void* RunThreadNRT(void* data) {
-#if SET_CPU
-        setCPU(1);
-#endif
-        printf("[NRT thread #%lu] running on CPU #%d\n", pthread_self(), sched_getcpu());
-        ThreadNRT* thread = static_cast<ThreadNRT*>(data);
-        thread->Run();
-        return NULL;
+    // NRT work-stealing runtime on the cores RT work leaves free; it exists
+    // before the apps so NRT workloads can size per-worker scratch.
+    // Workers are numbered after the apps and pipeline stages.
+    std::unique_ptr<StealRuntime> runtime;
+    if (spec.steal_workers != 0) {
+        cpu_set_t cpus = spec.steal_pinned ? spec.steal_cpus : NrtCpus(spec);
+        int first_id = (int)(spec.threads.size() + spec.stages.size()) + 1;
+        runtime.reset(new StealRuntime(first_id, cpus, spec.steal_workers > 0 ? spec.steal_workers : 0));
+        printf("NRT steal runtime: %d workers on CPUs %s\n", runtime->workers(), FormatCpuList(cpus).c_str());
+        g_nrt_runtime = runtime.get();
     }
 
-public:
-    int app_id_;
-
-    ThreadNRT(int app_id) : app_id_(app_id) {}
-
-    void Start() {
-        // Start the timer
-        gettimeofday(&start_time, NULL);
+    // Clock and temperature over the run, so Join() can tell a throttled
+    // app from a scheduling effect
+    std::unique_ptr<ThermalSampler> thermal;
+    if (spec.thermal_ms > 0) {
+        thermal.reset(new ThermalSampler(spec.thermal_ms, !spec.trace.empty()));
+        if (thermal->empty()) thermal.reset();
+    }
 
-        // Create the pthread
-        int ret = pthread_create(&thread_, NULL, &ThreadNRT::RunThreadNRT, this);
-        if (ret) {
-            throw std::runtime_error{std::string("pthread_create failed: ") + std::strerror(ret)};
+    // Live counters: the page exists before the apps so each can claim a slot
+    if (!spec.metrics.empty()) MetricsOpen(spec.metrics, spec.description);
+
+    std::vector<std::unique_ptr<AppTypeX>> rt_apps;
+    std::vector<std::unique_ptr<AppTypeY>> nrt_apps;
+    std::vector<std::unique_ptr<AppTypeZ>> stress_apps;
+    for (const ThreadSpec& t : spec.threads) {
+        if (t.cls == THREAD_RT) {
+            AppTypeX* app = new AppTypeX(t.app_id, t.priority, t.policy, t);
+            if (!spec.trace.empty()) app->EnableTrace(TraceName(t));
+            app->EnableMetrics(ThreadClassName(t.cls), t.workload);
+            if (t.pinned) app->SetAffinity(t.stream >= 0 ? StreamCpu(t) : t.cpus);
+            if (t.period_us > 0) app->SetPeriodic(t.period_us, t.deadline_us, t.cycles);
+            app->SetOverrunPolicy(t.overrun);
+            if (t.policy == SCHED_DEADLINE) app->SetDeadline(t.runtime_us, t.deadline_us, t.period_us);
+            rt_apps.emplace_back(app);
+        } else if (t.cls == THREAD_STRESS) {
+            AppTypeZ* app = new AppTypeZ(t.app_id, t);
+            if (!spec.trace.empty()) app->EnableTrace(TraceName(t));
+            app->EnableMetrics(ThreadClassName(t.cls), t.workload);
+            if (t.pinned) app->SetAffinity(t.cpus);
+            stress_apps.emplace_back(app);
+        } else {
+            AppTypeY* app = new AppTypeY(t.app_id, t);
+            if (!spec.trace.empty()) app->EnableTrace(TraceName(t));
+            app->EnableMetrics(ThreadClassName(t.cls), t.workload);
+            if (t.pinned) app->SetAffinity(t.cpus);
+            nrt_apps.emplace_back(app);
         }
     }
 
-    void Join() {
-        // Wait for the thread to finish
-        pthread_join(thread_, NULL);
-
-        // End the timer and calculate elapsed time
-        struct timeval end_time;
-        gettimeofday(&end_time, NULL);
-
-        long seconds = end_time.tv_sec - start_time.tv_sec;
-        long micros = (end_time.tv_usec - start_time.tv_usec);
-        double elapsed_time = seconds + micros * 1e-6;
-        printf("App #%d runtime: %f seconds\n", app_id_, elapsed_time);
+    // CannyP3 pipeline stages are numbered after the plain apps
+    std::unique_ptr<CannyPipeline> pipeline;
+    if (!spec.stages.empty()) {
+        pipeline.reset(new CannyPipeline(spec.stages, (int)spec.threads.size() + 1));
+        if (!spec.trace.empty()) pipeline->EnableTrace();
+        pipeline->EnableMetrics();
+        if (!pipeline->Open()) {
+            throw std::runtime_error{"cannot open the CannyP3 pipeline input"};
+        }
+    }
 
-        printf("[NRT thread #%lu] App #%d Ends\n", thread_, app_id_);
+    // Apps (and their latency histograms) exist and are touched before locking;
+    // from here on the heap only grows into memory that is already resident
+    RtProcessInit(spec.heap_reserve_mb);
+    if (spec.metrics_port > 0) MetricsServe(spec.metrics_port, NrtCpus(spec));
+    if (thermal) {
+        thermal->Start(NrtCpus(spec));
+        g_thermal_sampler = thermal.get();
     }
 
-    virtual void Run() = 0;
-};
+    // Stress load covers the whole measurement window: up before the first
+    // app starts, stopped only after the last one has been joined
+    for (auto& app : stress_apps) app->Start();
 
-class AppTypeX : public ThreadRT {
-public:
-    AppTypeX(int app_id, int priority, int policy) : ThreadRT(app_id, priority, policy) {}
+    if (runtime) runtime->Start();
+    if (pipeline) pipeline->Start();
 
-    void Run() {
-        printf("Running App #%d...\n", app_id_);
-        // Simulate compute-intensive task
-        BusyCal();
+    size_t x = 0, y = 0;
+    for (const ThreadSpec& t : spec.threads) {
+        if (t.cls == THREAD_RT) {
+            rt_apps[x++]->Start();
+        } else if (t.cls == THREAD_NRT) {
+            nrt_apps[y++]->Start();
+        }
+    }
+    x = y = 0;
+    for (const ThreadSpec& t : spec.threads) {
+        if (t.cls == THREAD_RT) {
+            rt_apps[x++]->Join();
+        } else if (t.cls == THREAD_NRT) {
+            nrt_apps[y++]->Join();
+        }
+    }
+    if (pipeline) pipeline->Join();
+    PrintStreamSummary();
+    if (runtime) {
+        runtime->Close();
+        g_nrt_runtime = NULL;
     }
-};
 
-class AppTypeY : public ThreadNRT {
-public:
-    AppTypeY(int app_id) : ThreadNRT(app_id) {}
+    for (auto& app : stress_apps) app->Stop();
+    for (auto& app : stress_apps) app->Join();
+    if (thermal) {
+        thermal->Stop();
+        g_thermal_sampler = NULL;
+    }
 
-    void Run() {
-        printf("Running App #%d...\n", app_id_);
-        // Simulate compute-intensive task
-        BusyCal();
+    // Every traced thread has exited, so the rings are quiescent
+    if (!spec.trace.empty()) TraceDump(spec.trace);
+    MetricsClose();
+
+    std::vector<AppResult> results;
+    size_t z = 0;
+    x = y = 0;
+    for (const ThreadSpec& t : spec.threads) {
+        AppResult r;
+        r.app_id = t.app_id;
+        r.cls = t.cls;
+        r.workload = t.workload;
+        if (t.cls == THREAD_RT) {
+            const AppTypeX& app = *rt_apps[x++];
+            r.runtime_sec = app.runtime_sec();
+            r.cpu_sec = app.cpu_ns() * 1e-9;
+            r.periodic = app.periodic();
+            r.cycles = app.cycles();
+            r.overruns = app.overruns();
+            r.lat_avg_us = app.latency().avg_us();
+            r.lat_p99_us = app.latency().Percentile(0.99);
+            r.lat_max_us = app.latency().max_us();
+        } else if (t.cls == THREAD_STRESS) {
+            const AppTypeZ& app = *stress_apps[z++];
+            r.runtime_sec = app.runtime_sec();
+            r.cpu_sec = app.cpu_ns() * 1e-9;
+        } else {
+            const AppTypeY& app = *nrt_apps[y++];
+            r.runtime_sec = app.runtime_sec();
+            r.cpu_sec = app.cpu_ns() * 1e-9;
+        }
+        results.push_back(r);
     }
-};
+    return results;
+}
 
 int main(int argc, char** argv) {
-    int exp_id = 4;
-    if (argc < 2) {
-        fprintf(stderr, "WARNING: default exp_id=0\n");
-    } else {
-        exp_id = atoi(argv[1]);
+    // One-off preprocessing: decode the clip so runs can use input_raw
+    if (argc >= 2 && std::string(argv[1]) == "--decode") {
+        int cols = WIDTH, rows = HEIGHT;
+        if (argc >= 4 && (sscanf(argv[3], "%dx%d", &cols, &rows) != 2 || cols < 3 || rows < 3)) {
+            printf("ERROR: size must be WIDTHxHEIGHT, e.g. 640x480\n");
+            return 1;
+        }
+        return DecodeToRaw(argc >= 3 ? argv[2] : "ground_crew_480p.raw", rows, cols) ? 0 : 1;
     }
-
-    LockMemory();
-
-    if (exp_id == 0) {
-        printf("Experiment 1: One CannyP3 APP (RT) and Two any-type APPs (NRT), All running on CPU=1\n");
-        // One CannyP3 APP (RT) and Two any-type APPs (NRT), All running on CPU=1
-        AppTypeX app1(1, 80, SCHED_FIFO);
-        AppTypeY app2(2);
-        AppTypeY app3(3);
-
-        app1.Start();
-        app2.Start();
-        app3.Start();
-
-        app1.Join();
-        app2.Join();
-        app3.Join();
+    // Live counters of a running experiment (p3_metrics.h)
+    if (argc >= 2 && std::string(argv[1]) == "--stats") {
+        return MetricsCli(argc >= 3 ? argv[2] : "/p3", argc >= 4 ? atoi(argv[3]) : 0);
     }
-    else if (exp_id == 1) {
-        printf("Experiment 2: Same workload as 1, but freely run on available CPUs\n");
-        // Same workload as 1, but freely run on available CPUs
-        AppTypeX app1(1, 80, SCHED_FIFO);
-        AppTypeY app2(2);
-        AppTypeY app3(3);
-
-        app1.Start();
-        app2.Start();
-        app3.Start();
-
-        app1.Join();
-        app2.Join();
-        app3.Join();
+    // Detector consistency across cached kernels (p3_canny.h)
+    if (argc >= 2 && std::string(argv[1]) == "--check") {
+        return CannySelfCheck() ? 1 : 0;
     }
-    else if (exp_id == 2) {
-        printf("Experiment 3: Two any-type APPs (same priority, SCHED_FIFO) in RT and One any-type APP (NRT), All running on CPU=1\n");
-        // Two any-type APPs (same priority, SCHED_FIFO) in RT and One any-type APP (NRT), All running on CPU=1
-        AppTypeX app1(1, 80, SCHED_FIFO);
-        AppTypeX app2(2, 80, SCHED_FIFO);
-        AppTypeY app3(3);
-
-        app1.Start();
-        app2.Start();
-        app3.Start();
-
-        app1.Join();
-        app2.Join();
-        app3.Join();
+    // Repeated runs over a parameter grid (p3_sweep.h)
+    if (argc >= 3 && std::string(argv[1]) == "--sweep") {
+        printf("Timing backend: %s\n", TimingBackend());
+        return RunSweep(argv[2], RunExperiment);
     }
-    else if (exp_id == 3) {
-        printf("Experiment 4: Two any-type APPs (same priority, SCHED_RR) in RT and One any-type APP (NRT), All running on CPU=1\n");
-        // Two any-type APPs (same priority, SCHED_RR) in RT and One any-type APP (NRT), All running on CPU=1
-        AppTypeX app1(1, 80, SCHED_RR);
-        AppTypeX app2(2, 80, SCHED_RR);
-        AppTypeY app3(3);
-
-        app1.Start();
-        app2.Start();
-        app3.Start();
-
-        app1.Join();
-        app2.Join();
-        app3.Join();
+
+    // The host checks alone, for the experiment's RT cores and priorities
+    bool preflight_only = argc >= 3 && std::string(argv[1]) == "--preflight";
+    if (preflight_only) {
+        argv++;
+        argc--;
     }
-    else if (exp_id == 4) {
-        printf("Experiment 5: Same workload as 3, but freely run on available CPUs\n");
-        // Same workload as 3, but freely run on available CPUs
-        AppTypeX app1(1, 80, SCHED_FIFO);
-        AppTypeX app2(2, 80, SCHED_FIFO);
-        AppTypeY app3(3);
-
-        app1.Start();
-        app2.Start();
-        app3.Start();
-
-        app1.Join();
-        app2.Join();
-        app3.Join();
+
+    ExperimentSpec spec;
+    try {
+        if (argc >= 3 && std::string(argv[1]) == "-f") {
+            spec = LoadExperimentFile(argv[2]);
+        } else if (preflight_only && std::string(argv[1]).find(".ini") != std::string::npos) {
+            spec = LoadExperimentFile(argv[1]);
+        } else {
+            int exp_id = 4;
+            if (argc < 2) {
+                fprintf(stderr, "WARNING: default exp_id=%d\n", exp_id);
+            } else {
+                exp_id = atoi(argv[1]);
+            }
+            spec = BuiltinExperiment(exp_id);
+        }
+    } catch (const std::exception& e) {
+        printf("ERROR: %s\n", e.what());
+        printf("Usage: %s <exp_id 0-%d> | -f <experiment.ini> | --sweep <sweep.ini> | --decode [out.raw [WxH]]\n"
+               "       | --preflight <exp_id | experiment.ini> | --stats [/shm-name [seconds]] | --check\n",
+               argv[0], NumBuiltinExperiments() - 1);
+        return 1;
     }
-    else {
-        printf("ERROR: exp_id NOT FOUND\n");
+    if (preflight_only) return RunPreflight(spec) > 0 ? 1 : 0;
+
+    printf("Timing backend: %s\n", TimingBackend());
+    try {
+        RunExperiment(spec);
+    } catch (const std::exception& e) {
+        printf("ERROR: %s\n", e.what());
+        return 1;
     }
 
     return 0;
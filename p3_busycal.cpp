@@ -0,0 +1,114 @@
+#include "p3_busycal.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "p3_timing.h"
+
+#define ALU_STEPS_PER_CHUNK 1024
+#define FP_STEPS_PER_CHUNK 256
+#define MEM_LINES_PER_CHUNK 1024
+#define LINE_WORDS (64 / sizeof(uint64_t))
+#define CALIBRATE_MIN_NS 20000000  // 20 ms of CPU time per calibration
+
+static volatile uint64_t g_busy_sink;
+
+bool BusyFlavorFromName(const char* name, BusyFlavor* flavor) {
+    if (strcmp(name, "alu") == 0) {
+        *flavor = BUSY_ALU;
+    } else if (strcmp(name, "fp") == 0) {
+        *flavor = BUSY_FP;
+    } else if (strcmp(name, "mem") == 0) {
+        *flavor = BUSY_MEM;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* BusyFlavorName(BusyFlavor flavor) {
+    switch (flavor) {
+        case BUSY_FP:
+            return "fp";
+        case BUSY_MEM:
+            return "mem";
+        default:
+            return "alu";
+    }
+}
+
+BusyWork::BusyWork(const BusySpec& spec) : spec_(spec) {
+    if (spec_.flavor == BUSY_MEM) {
+        // Whole lines, at least one chunk's worth
+        size_t lines = (size_t)spec_.mem_kb * 1024 / 64;
+        if (lines < MEM_LINES_PER_CHUNK) lines = MEM_LINES_PER_CHUNK;
+        buf_.assign(lines * LINE_WORDS, 1);
+        RunChunks(lines / MEM_LINES_PER_CHUNK);  // warm the buffer once
+    }
+
+    // Double the chunk count until the run is long enough to time; CPU
+    // time, not wall time, so a preempted calibration is not skewed
+    uint64_t chunks = 16, ns = 0;
+    for (;;) {
+        uint64_t start = ThreadCpuNs();
+        RunChunks(chunks);
+        ns = ThreadCpuNs() - start;
+        if (ns >= CALIBRATE_MIN_NS) break;
+        chunks *= 2;
+    }
+    chunks_per_us_ = chunks * 1000.0 / ns;
+    chunks_per_unit_ = (uint64_t)(chunks_per_us_ * spec_.work_us + 0.5);
+    if (chunks_per_unit_ == 0) chunks_per_unit_ = 1;
+}
+
+void BusyWork::RunChunks(uint64_t chunks) {
+    switch (spec_.flavor) {
+        case BUSY_ALU: {
+            uint64_t x = 88172645463325252ULL;
+            for (uint64_t c = 0; c < chunks; c++) {
+                for (int i = 0; i < ALU_STEPS_PER_CHUNK; i++) {
+                    x ^= x << 13;
+                    x ^= x >> 7;
+                    x ^= x << 17;
+                }
+            }
+            g_busy_sink = x;
+            break;
+        }
+        case BUSY_FP: {
+            float acc[16];
+            for (int k = 0; k < 16; k++) acc[k] = 1.0f + k;
+            for (uint64_t c = 0; c < chunks; c++) {
+                for (int i = 0; i < FP_STEPS_PER_CHUNK; i++) {
+                    // Contracting toward 2.0, so values stay finite forever
+                    for (int k = 0; k < 16; k++) acc[k] = acc[k] * 0.999f + 0.002f;
+                }
+            }
+            float sum = 0;
+            for (int k = 0; k < 16; k++) sum += acc[k];
+            g_busy_sink = (uint64_t)sum;
+            break;
+        }
+        case BUSY_MEM: {
+            uint64_t* buf = buf_.data();
+            size_t lines = buf_.size() / LINE_WORDS;
+            uint64_t sum = 0;
+            for (uint64_t c = 0; c < chunks; c++) {
+                for (int i = 0; i < MEM_LINES_PER_CHUNK; i++) {
+                    // Each store depends on the previous load
+                    uint64_t* line = buf + pos_ * LINE_WORDS;
+                    sum += line[0];
+                    line[0] = sum;
+                    if (++pos_ == lines) pos_ = 0;
+                }
+            }
+            g_busy_sink = sum;
+            break;
+        }
+    }
+}
+
+void BusyCal() {
+    static BusyWork work{BusySpec()};
+    work.Run();
+}
@@ -0,0 +1,59 @@
+/**
+ * Calibrated synthetic CPU work.
+ *
+ * Work is asked for in microseconds of on-CPU time rather than loop
+ * iterations: each BusyWork measures its kernel's rate once, at
+ * construction (before any app thread starts), with CLOCK_THREAD_CPUTIME_ID,
+ * and Run() then executes the matching number of chunks. Every kernel
+ * feeds a volatile sink, so no optimization level can delete it.
+ *
+ * Flavors:
+ *   alu - dependent xorshift chain, integer pipeline only
+ *   fp  - 16 independent multiply-add chains (NEON-vectorizable)
+ *   mem - dependent read-modify-write, one cache line per step, over a
+ *         buffer of mem_kb
+ */
+#ifndef P3_BUSYCAL_H
+#define P3_BUSYCAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+enum BusyFlavor { BUSY_ALU, BUSY_FP, BUSY_MEM };
+
+bool BusyFlavorFromName(const char* name, BusyFlavor* flavor);
+const char* BusyFlavorName(BusyFlavor flavor);
+
+// As configured by busy_flavor / busy_us / busy_kb
+struct BusySpec {
+    BusyFlavor flavor = BUSY_ALU;
+    long work_us = 1000000;  // per BusyCal unit
+    long mem_kb = 8192;      // mem flavor only; 4x the Pi 5 L3
+};
+
+class BusyWork {
+   public:
+    explicit BusyWork(const BusySpec& spec);
+
+    // One unit: spec.work_us of on-CPU work
+    void Run() { RunChunks(chunks_per_unit_); }
+
+    double chunks_per_us() const { return chunks_per_us_; }
+
+   private:
+    void RunChunks(uint64_t chunks);
+
+    BusySpec spec_;
+    std::vector<uint64_t> buf_;  // mem flavor
+    size_t pos_ = 0;
+    double chunks_per_us_ = 0;
+    uint64_t chunks_per_unit_ = 0;
+};
+
+// The original entry point: one default unit (1 s of ALU work)
+void BusyCal();
+
+#endif
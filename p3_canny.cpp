@@ -0,0 +1,769 @@
+#include "p3_canny.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#if CANNY_NEON
+#include <arm_neon.h>
+#endif
+
+#define BOOSTBLURFACTOR 90.0
+
+bool CannyModeFromName(const char* name, CannyMode* mode) {
+    if (strcmp(name, "float") == 0) {
+        *mode = CANNY_FLOAT;
+    } else if (strcmp(name, "int") == 0) {
+        *mode = CANNY_INT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* CannyModeName(CannyMode mode) { return mode == CANNY_INT ? "int" : "float"; }
+
+// Frame geometry for the kernels below. With FixedDims every row stride and
+// loop bound is a compile-time constant, so the compiler can unroll and
+// vectorize without runtime trip counts or aliasing checks on the stride;
+// RuntimeDims carries the size as values for everything else.
+template <int Rows, int Cols>
+struct FixedDims {
+    static constexpr int rows() { return Rows; }
+    static constexpr int cols() { return Cols; }
+};
+
+struct RuntimeDims {
+    int r, c;
+    int rows() const { return r; }
+    int cols() const { return c; }
+};
+
+static size_t Align16(size_t n) { return (n + 15) & ~(size_t)15; }
+
+size_t CannyScratchBytes(int rows, int cols) {
+    size_t n = (size_t)rows * cols;
+    return Align16(n * sizeof(float)) + 4 * Align16(n * sizeof(short)) + Align16(n) +
+           Align16(CANNY_MAX_MAG * sizeof(int)) + Align16(n * sizeof(int));
+}
+
+void CannyBuffersInit(CannyBuffers* buf, int rows, int cols, void* mem) {
+    size_t n = (size_t)rows * cols;
+    char* p = static_cast<char*>(mem);
+    buf->rows = rows;
+    buf->cols = cols;
+    buf->kernel_sigma = -1;
+    buf->kernel_size = 0;
+    buf->ikernel_sigma = -1;
+    buf->ikernel_size = 0;
+    buf->tempim = reinterpret_cast<float*>(p);
+    buf->tempim16 = reinterpret_cast<unsigned short*>(p);
+    buf->magsq = reinterpret_cast<unsigned int*>(p);
+    p += Align16(n * sizeof(float));
+    buf->smoothed = reinterpret_cast<short*>(p);
+    p += Align16(n * sizeof(short));
+    buf->delta_x = reinterpret_cast<short*>(p);
+    p += Align16(n * sizeof(short));
+    buf->delta_y = reinterpret_cast<short*>(p);
+    p += Align16(n * sizeof(short));
+    buf->magnitude = reinterpret_cast<short*>(p);
+    p += Align16(n * sizeof(short));
+    buf->nms = reinterpret_cast<unsigned char*>(p);
+    p += Align16(n);
+    buf->hist = reinterpret_cast<int*>(p);
+    p += Align16(CANNY_MAX_MAG * sizeof(int));
+    buf->stack = reinterpret_cast<int*>(p);
+}
+
+// 1-D Gaussian of width 1 + 2*ceil(2.5*sigma), normalized to sum 1. Cached
+// in the buffers so a constant sigma costs nothing per frame.
+static void MakeGaussianKernel(float sigma, CannyBuffers* buf) {
+    if (buf->kernel_sigma == sigma) return;
+    int windowsize = 1 + 2 * (int)ceil(2.5 * sigma);
+    if (windowsize > CANNY_MAX_KERNEL) windowsize = CANNY_MAX_KERNEL - 1;
+    int center = windowsize / 2;
+
+    float sum = 0;
+    for (int i = 0; i < windowsize; i++) {
+        float x = (float)(i - center);
+        float fx = (float)(pow(2.71828, -0.5 * x * x / (sigma * sigma)) / (sigma * sqrt(6.2831853)));
+        buf->kernel[i] = fx;
+        sum += fx;
+    }
+    for (int i = 0; i < windowsize; i++) buf->kernel[i] /= sum;
+    buf->kernel_size = windowsize;
+    buf->kernel_sigma = sigma;
+}
+
+// One output pixel of each blur pass; taps falling off the image are
+// dropped and the remaining weights renormalized
+static inline float BlurXAt(const unsigned char* row, int c, int cols, const float* kernel, int center) {
+    float dot = 0, sum = 0;
+    for (int cc = -center; cc <= center; cc++) {
+        if (c + cc >= 0 && c + cc < cols) {
+            dot += (float)row[c + cc] * kernel[center + cc];
+            sum += kernel[center + cc];
+        }
+    }
+    return dot / sum;
+}
+
+// tempim points at image row t0; rows outside [0, rows) are dropped
+static inline short BlurYAt(const float* tempim, int t0, int r, int c, int rows, int cols, const float* kernel,
+                            int center) {
+    float dot = 0, sum = 0;
+    for (int rr = -center; rr <= center; rr++) {
+        if (r + rr >= 0 && r + rr < rows) {
+            dot += tempim[(r + rr - t0) * cols + c] * kernel[center + rr];
+            sum += kernel[center + rr];
+        }
+    }
+    return (short)(dot * BOOSTBLURFACTOR / sum + 0.5);
+}
+
+// Row kernels shared by the full-frame and banded paths. Each works on one
+// image row; on aarch64 the interior runs 4/8 lanes at a time with NEON and
+// the pixels whose taps leave the image go through the scalar helpers.
+
+template <class D>
+static void BlurXRow(D d, const unsigned char* row, float* out, const float* kernel, int size) {
+    const int cols = d.cols();
+    int center = size / 2;
+    int c = 0;
+    for (; c < center && c < cols; c++) out[c] = BlurXAt(row, c, cols, kernel, center);
+#if CANNY_NEON
+    float ksum = 0;
+    for (int k = 0; k < size; k++) ksum += kernel[k];
+    float32x4_t vksum = vdupq_n_f32(ksum);
+    // 8 pixels per step, u8 widened to two float32x4 accumulators
+    for (; c + 8 <= cols - center; c += 8) {
+        float32x4_t lo = vdupq_n_f32(0), hi = vdupq_n_f32(0);
+        for (int k = 0; k < size; k++) {
+            uint16x8_t px = vmovl_u8(vld1_u8(row + c - center + k));
+            lo = vfmaq_n_f32(lo, vcvtq_f32_u32(vmovl_u16(vget_low_u16(px))), kernel[k]);
+            hi = vfmaq_n_f32(hi, vcvtq_f32_u32(vmovl_u16(vget_high_u16(px))), kernel[k]);
+        }
+        vst1q_f32(out + c, vdivq_f32(lo, vksum));
+        vst1q_f32(out + c + 4, vdivq_f32(hi, vksum));
+    }
+#endif
+    for (; c < cols; c++) out[c] = BlurXAt(row, c, cols, kernel, center);
+}
+
+// Vertical blur of image row r; tempim holds rows from t0 on
+template <class D>
+static void BlurYRow(D d, const float* tempim, int t0, int r, const float* kernel, int size, short* out) {
+    const int rows = d.rows(), cols = d.cols();
+    int center = size / 2;
+    if (r < center || r >= rows - center) {
+        for (int c = 0; c < cols; c++) out[c] = BlurYAt(tempim, t0, r, c, rows, cols, kernel, center);
+        return;
+    }
+    int c = 0;
+#if CANNY_NEON
+    float ksum = 0;
+    for (int k = 0; k < size; k++) ksum += kernel[k];
+    const float* base = tempim + (r - center - t0) * cols;
+    float32x4_t vscale = vdupq_n_f32((float)BOOSTBLURFACTOR / ksum);
+    float32x4_t vhalf = vdupq_n_f32(0.5f);
+    for (; c + 8 <= cols; c += 8) {
+        float32x4_t lo = vdupq_n_f32(0), hi = vdupq_n_f32(0);
+        for (int k = 0; k < size; k++) {
+            lo = vfmaq_n_f32(lo, vld1q_f32(base + k * cols + c), kernel[k]);
+            hi = vfmaq_n_f32(hi, vld1q_f32(base + k * cols + c + 4), kernel[k]);
+        }
+        // (short)(x + 0.5) truncates toward zero; x >= 0 here
+        int32x4_t ilo = vcvtq_s32_f32(vfmaq_f32(vhalf, lo, vscale));
+        int32x4_t ihi = vcvtq_s32_f32(vfmaq_f32(vhalf, hi, vscale));
+        vst1q_s16(out + c, vcombine_s16(vmovn_s32(ilo), vmovn_s32(ihi)));
+    }
+#endif
+    for (; c < cols; c++) out[c] = BlurYAt(tempim, t0, r, c, rows, cols, kernel, center);
+}
+
+// x derivative of one row: central differences, one-sided at the ends
+template <class D>
+static void DerivXRow(D d, const short* s, short* dx) {
+    const int cols = d.cols();
+    dx[0] = s[1] - s[0];
+    int c = 1;
+#if CANNY_NEON
+    for (; c + 8 <= cols - 1; c += 8) {
+        vst1q_s16(dx + c, vsubq_s16(vld1q_s16(s + c + 1), vld1q_s16(s + c - 1)));
+    }
+#endif
+    for (; c < cols - 1; c++) dx[c] = s[c + 1] - s[c - 1];
+    dx[cols - 1] = s[cols - 1] - s[cols - 2];
+}
+
+// dy = a - b, where a/b are the rows below/above (or the row itself at the
+// top and bottom image borders)
+template <class D>
+static void DerivYRow(D d, const short* a, const short* b, short* dy) {
+    const int cols = d.cols();
+    int c = 0;
+#if CANNY_NEON
+    for (; c + 8 <= cols; c += 8) vst1q_s16(dy + c, vsubq_s16(vld1q_s16(a + c), vld1q_s16(b + c)));
+#endif
+    for (; c < cols; c++) dy[c] = a[c] - b[c];
+}
+
+static void MagnitudeRow(const short* gx, const short* gy, short* mag, int n) {
+    int pos = 0;
+#if CANNY_NEON
+    float32x4_t vhalf = vdupq_n_f32(0.5f);
+    for (; pos + 8 <= n; pos += 8) {
+        int16x8_t x = vld1q_s16(gx + pos);
+        int16x8_t y = vld1q_s16(gy + pos);
+        int32x4_t sq1lo = vmull_s16(vget_low_s16(x), vget_low_s16(x));
+        int32x4_t sq1hi = vmull_s16(vget_high_s16(x), vget_high_s16(x));
+        int32x4_t sq2lo = vmull_s16(vget_low_s16(y), vget_low_s16(y));
+        int32x4_t sq2hi = vmull_s16(vget_high_s16(y), vget_high_s16(y));
+        float32x4_t mlo = vsqrtq_f32(vaddq_f32(vcvtq_f32_s32(sq1lo), vcvtq_f32_s32(sq2lo)));
+        float32x4_t mhi = vsqrtq_f32(vaddq_f32(vcvtq_f32_s32(sq1hi), vcvtq_f32_s32(sq2hi)));
+        int32x4_t ilo = vcvtq_s32_f32(vaddq_f32(mlo, vhalf));
+        int32x4_t ihi = vcvtq_s32_f32(vaddq_f32(mhi, vhalf));
+        vst1q_s16(mag + pos, vcombine_s16(vmovn_s32(ilo), vmovn_s32(ihi)));
+    }
+#endif
+    for (; pos < n; pos++) {
+        int sq1 = (int)gx[pos] * gx[pos];
+        int sq2 = (int)gy[pos] * gy[pos];
+        mag[pos] = (short)(0.5 + sqrtf((float)sq1 + (float)sq2));
+    }
+}
+
+// Keep pixels whose magnitude is a local maximum along the gradient
+// direction, comparing against the two neighbors interpolated on each side.
+// mag/gx/gy point at an interior row; mag rows above and below must be
+// contiguous with it.
+template <class D>
+static void NonMaxSuppRow(D d, const short* mag, const short* gx, const short* gy, unsigned char* result) {
+    const int cols = d.cols();
+    result[0] = 0;
+    result[cols - 1] = 0;
+    for (int c = 1; c < cols - 1; c++) {
+        short m00 = mag[c];
+        if (m00 == 0) {
+            result[c] = NOEDGE;
+            continue;
+        }
+        float xperp = (float)gx[c] / m00;
+        float yperp = (float)gy[c] / m00;
+        float ax = fabsf(xperp), ay = fabsf(yperp);
+
+        // Step one pixel along the dominant axis and interpolate across the
+        // other; sx/sy give the direction of the gradient
+        int sx = gx[c] >= 0 ? 1 : -1;
+        int sy = gy[c] >= 0 ? 1 : -1;
+        float w, m1, m2;
+        if (ax >= ay) {
+            w = ay / ax;
+            m1 = (1 - w) * mag[c + sx] + w * mag[c + sx + sy * cols];
+            m2 = (1 - w) * mag[c - sx] + w * mag[c - sx - sy * cols];
+        } else {
+            w = ax / ay;
+            m1 = (1 - w) * mag[c + sy * cols] + w * mag[c + sy * cols + sx];
+            m2 = (1 - w) * mag[c - sy * cols] + w * mag[c - sy * cols - sx];
+        }
+        result[c] = (m00 > m1 && m00 >= m2) ? POSSIBLE_EDGE : NOEDGE;
+    }
+}
+
+static void MakeBandHalo(int r0, int center, int* t0, int* s0, int* g0) {
+    // NMS of [r0, r1) reads gradients of r0-1..r1, which read smoothed rows
+    // r0-2..r1+1, which read horizontal blur rows center further out
+    *g0 = r0 - 1 > 0 ? r0 - 1 : 0;
+    *s0 = r0 - 2 > 0 ? r0 - 2 : 0;
+    *t0 = r0 - 2 - center > 0 ? r0 - 2 - center : 0;
+}
+
+template <class D>
+static void CannyBandIntoT(D d, const unsigned char* image, int r0, int r1, CannyBuffers* buf, CannyBand* band) {
+    const int rows = d.rows(), cols = d.cols();
+    const float* kernel = buf->kernel;
+    int size = buf->kernel_size;
+    int center = size / 2;
+    int t0, s0, g0;
+    MakeBandHalo(r0, center, &t0, &s0, &g0);
+    int t1 = r1 + 2 + center < rows ? r1 + 2 + center : rows;
+    int s1 = r1 + 2 < rows ? r1 + 2 : rows;
+    int g1 = r1 + 1 < rows ? r1 + 1 : rows;
+
+    for (int r = t0; r < t1; r++) {
+        BlurXRow(d, image + r * cols, band->tempim + (r - t0) * cols, kernel, size);
+    }
+    for (int r = s0; r < s1; r++) {
+        BlurYRow(d, band->tempim, t0, r, kernel, size, band->smoothed + (r - s0) * cols);
+    }
+    for (int r = g0; r < g1; r++) {
+        const short* s = band->smoothed + (r - s0) * cols;
+        short* dx = band->delta_x + (r - g0) * cols;
+        short* dy = band->delta_y + (r - g0) * cols;
+        DerivXRow(d, s, dx);
+        if (r == 0) {
+            DerivYRow(d, s + cols, s, dy);
+        } else if (r == rows - 1) {
+            DerivYRow(d, s, s - cols, dy);
+        } else {
+            DerivYRow(d, s + cols, s - cols, dy);
+        }
+    }
+    MagnitudeRow(band->delta_x, band->delta_y, band->magnitude, (g1 - g0) * cols);
+
+    for (int r = r0; r < r1; r++) {
+        int local = (r - g0) * cols;
+        if (r == 0 || r == rows - 1) {
+            memset(buf->nms + r * cols, 0, cols);
+        } else {
+            NonMaxSuppRow(d, band->magnitude + local, band->delta_x + local, band->delta_y + local, buf->nms + r * cols);
+        }
+    }
+    // Hysteresis reads the magnitude of the whole frame
+    if (band->magnitude != buf->magnitude) {
+        memcpy(buf->magnitude + r0 * cols, band->magnitude + (r0 - g0) * cols, (size_t)(r1 - r0) * cols * sizeof(short));
+    }
+}
+
+void CannyBandInto(const unsigned char* image, int rows, int cols, int r0, int r1, CannyBuffers* buf,
+                   CannyBand* band) {
+    CannyBandIntoT(RuntimeDims{rows, cols}, image, r0, r1, buf, band);
+}
+
+// Hysteresis: seed edges above the high threshold, then grow them through
+// 8-connected candidates above the low threshold. Uses an explicit stack
+// instead of recursion so RT stack usage stays bounded.
+template <class D>
+static void ApplyHysteresis(D d, float tlow, float thigh, unsigned char* edge, CannyBuffers* buf) {
+    const int rows = d.rows(), cols = d.cols();
+    const short* mag = buf->magnitude;
+    const unsigned char* nms = buf->nms;
+    int* hist = buf->hist;
+    int n = rows * cols;
+
+    for (int pos = 0; pos < n; pos++) {
+        edge[pos] = (nms[pos] == POSSIBLE_EDGE) ? POSSIBLE_EDGE : NOEDGE;
+    }
+    for (int r = 0; r < rows; r++) {
+        edge[r * cols] = NOEDGE;
+        edge[r * cols + cols - 1] = NOEDGE;
+    }
+    memset(edge, NOEDGE, cols);
+    memset(edge + (rows - 1) * cols, NOEDGE, cols);
+
+    // Histogram of candidate magnitudes picks the high threshold
+    memset(hist, 0, CANNY_MAX_MAG * sizeof(int));
+    int maxmag = 0;
+    for (int pos = 0; pos < n; pos++) {
+        if (edge[pos] == POSSIBLE_EDGE) {
+            hist[mag[pos]]++;
+            if (mag[pos] > maxmag) maxmag = mag[pos];
+        }
+    }
+    int numedges = 0;
+    for (int r = 1; r < CANNY_MAX_MAG; r++) numedges += hist[r];
+    int highcount = (int)(numedges * thigh + 0.5);
+
+    int r = 1;
+    numedges = hist[1];
+    while (r < maxmag - 1 && numedges < highcount) {
+        r++;
+        numedges += hist[r];
+    }
+    int highthreshold = r;
+    int lowthreshold = (int)(highthreshold * tlow + 0.5);
+
+    static const int dr[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+    static const int dc[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+    int* stack = buf->stack;
+    for (int pos = 0; pos < n; pos++) {
+        if (edge[pos] != POSSIBLE_EDGE || mag[pos] < highthreshold) continue;
+        edge[pos] = EDGE;
+        int top = 0;
+        stack[top++] = pos;
+        while (top > 0) {
+            int p = stack[--top];
+            for (int k = 0; k < 8; k++) {
+                // Border pixels are NOEDGE, so neighbors never leave the image
+                int q = p + dr[k] * cols + dc[k];
+                if (edge[q] == POSSIBLE_EDGE && mag[q] > lowthreshold) {
+                    edge[q] = EDGE;
+                    stack[top++] = q;
+                }
+            }
+        }
+    }
+
+    for (int pos = 0; pos < n; pos++) {
+        if (edge[pos] != EDGE) edge[pos] = NOEDGE;
+    }
+}
+
+void CannyPrepare(float sigma, CannyBuffers* buf) { MakeGaussianKernel(sigma, buf); }
+
+void CannyFinish(int rows, int cols, float tlow, float thigh, unsigned char* edge, CannyBuffers* buf) {
+    ApplyHysteresis(RuntimeDims{rows, cols}, tlow, thigh, edge, buf);
+}
+
+template <class D>
+static void CannyIntoT(D d, const unsigned char* image, float sigma, float tlow, float thigh, unsigned char* edge,
+                       CannyBuffers* buf) {
+    // The whole frame as one band, using the full-size scratch images
+    CannyBand whole = {buf->tempim, buf->smoothed, buf->delta_x, buf->delta_y, buf->magnitude};
+    MakeGaussianKernel(sigma, buf);
+    CannyBandIntoT(d, image, 0, d.rows(), buf, &whole);
+    ApplyHysteresis(d, tlow, thigh, edge, buf);
+}
+
+// ---------------------------------------------------------------------------
+// Integer mode
+
+// Quantize the float kernel to Q8 weights summing to exactly 256; the
+// rounding error is folded into the center tap
+static void MakeIntKernel(float sigma, CannyBuffers* buf) {
+    if (buf->ikernel_sigma == sigma) return;
+    MakeGaussianKernel(sigma, buf);
+    int size = buf->kernel_size;
+    int total = 0;
+    for (int k = 0; k < size; k++) {
+        buf->ikernel[k] = (unsigned short)(buf->kernel[k] * 256 + 0.5f);
+        total += buf->ikernel[k];
+    }
+    buf->ikernel[size / 2] += 256 - total;
+    buf->ikernel_sigma = sigma;
+    buf->ikernel_size = size;
+}
+
+// Border taps are renormalized by the weight actually used, as in the float
+// path; interior pixels see the full 256
+static inline unsigned short BlurXIntAt(const unsigned char* image, int r, int c, int cols, const unsigned short* k,
+                                        int center) {
+    unsigned int dot = 0, sum = 0;
+    for (int cc = -center; cc <= center; cc++) {
+        if (c + cc >= 0 && c + cc < cols) {
+            dot += image[r * cols + c + cc] * k[center + cc];
+            sum += k[center + cc];
+        }
+    }
+    return (unsigned short)((dot * 256 + sum / 2) / sum);
+}
+
+static inline short BlurYIntAt(const unsigned short* tempim, int r, int c, int rows, int cols,
+                               const unsigned short* k, int center) {
+    uint64_t dot = 0, sum = 0;
+    for (int rr = -center; rr <= center; rr++) {
+        if (r + rr >= 0 && r + rr < rows) {
+            dot += (uint64_t)tempim[(r + rr) * cols + c] * k[center + rr];
+            sum += k[center + rr];
+        }
+    }
+    // tempim is Q8 and the weights are Q8: scale by BOOSTBLURFACTOR / 2^16
+    return (short)((dot * (int)BOOSTBLURFACTOR + sum * 128) / (sum * 256));
+}
+
+template <class D>
+static void GaussianSmoothInt(D d, const unsigned char* image, CannyBuffers* buf) {
+    const int rows = d.rows(), cols = d.cols();
+    const unsigned short* k = buf->ikernel;
+    int size = buf->ikernel_size;
+    int center = size / 2;
+    unsigned short* tempim = buf->tempim16;
+    short* smoothed = buf->smoothed;
+
+    // x pass: u8 x Q8 fits 16 bits, so the interior accumulates in u16
+    // (8 lanes per 128-bit NEON op)
+    for (int r = 0; r < rows; r++) {
+        const unsigned char* row = image + r * cols;
+        unsigned short* out = tempim + r * cols;
+        int c = 0;
+        for (; c < center && c < cols; c++) out[c] = BlurXIntAt(image, r, c, cols, k, center);
+#if CANNY_NEON
+        for (; c + 16 <= cols - center; c += 16) {
+            uint16x8_t lo = vdupq_n_u16(0), hi = vdupq_n_u16(0);
+            for (int t = 0; t < size; t++) {
+                uint8x16_t px = vld1q_u8(row + c - center + t);
+                if (k[t] > 255) {
+                    // A lone 256 tap (tiny sigma) does not fit a u8 lane:
+                    // px * 256 = px * 255 + px
+                    lo = vaddw_u8(vmlal_u8(lo, vget_low_u8(px), vdup_n_u8(255)), vget_low_u8(px));
+                    hi = vaddw_u8(vmlal_u8(hi, vget_high_u8(px), vdup_n_u8(255)), vget_high_u8(px));
+                    continue;
+                }
+                uint8x8_t w = vdup_n_u8((uint8_t)k[t]);
+                lo = vmlal_u8(lo, vget_low_u8(px), w);
+                hi = vmlal_u8(hi, vget_high_u8(px), w);
+            }
+            vst1q_u16(out + c, lo);
+            vst1q_u16(out + c + 8, hi);
+        }
+#endif
+        for (; c < cols - center; c++) {
+            unsigned short dot = 0;
+            for (int t = 0; t < size; t++) dot += row[c - center + t] * k[t];
+            out[c] = dot;
+        }
+        for (; c < cols; c++) out[c] = BlurXIntAt(image, r, c, cols, k, center);
+    }
+
+    // y pass, row-major: u16 x Q8 accumulates in u32
+    for (int r = 0; r < rows; r++) {
+        short* out = smoothed + r * cols;
+        if (r < center || r >= rows - center) {
+            for (int c = 0; c < cols; c++) out[c] = BlurYIntAt(tempim, r, c, rows, cols, k, center);
+            continue;
+        }
+        const unsigned short* base = tempim + (r - center) * cols;
+        int c = 0;
+#if CANNY_NEON
+        uint32x4_t vboost = vdupq_n_u32((uint32_t)BOOSTBLURFACTOR);
+        uint32x4_t vround = vdupq_n_u32(1u << 15);
+        for (; c + 8 <= cols; c += 8) {
+            uint32x4_t lo = vdupq_n_u32(0), hi = vdupq_n_u32(0);
+            for (int t = 0; t < size; t++) {
+                uint16x8_t v = vld1q_u16(base + t * cols + c);
+                lo = vmlal_n_u16(lo, vget_low_u16(v), k[t]);
+                hi = vmlal_n_u16(hi, vget_high_u16(v), k[t]);
+            }
+            lo = vshrq_n_u32(vmlaq_u32(vround, lo, vboost), 16);
+            hi = vshrq_n_u32(vmlaq_u32(vround, hi, vboost), 16);
+            vst1q_s16(out + c, vreinterpretq_s16_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi))));
+        }
+#endif
+        for (; c < cols; c++) {
+            unsigned int dot = 0;
+            for (int t = 0; t < size; t++) dot += base[t * cols + c] * k[t];
+            out[c] = (short)((dot * (unsigned int)BOOSTBLURFACTOR + (1u << 15)) >> 16);
+        }
+    }
+}
+
+// Full-frame gradients from the shared row kernels
+template <class D>
+static void DerivativeXY(D d, CannyBuffers* buf) {
+    const int rows = d.rows(), cols = d.cols();
+    for (int r = 0; r < rows; r++) {
+        const short* s = buf->smoothed + r * cols;
+        DerivXRow(d, s, buf->delta_x + r * cols);
+        DerivYRow(d, r < rows - 1 ? s + cols : s, r > 0 ? s - cols : s, buf->delta_y + r * cols);
+    }
+}
+
+// Squared magnitude; |gradient| <= 2 * 255 * 90, so the square fits 32 bits
+template <class D>
+static void MagnitudeSqXY(D d, CannyBuffers* buf) {
+    const int n = d.rows() * d.cols();
+    const short* gx = buf->delta_x;
+    const short* gy = buf->delta_y;
+    unsigned int* magsq = buf->magsq;
+    int pos = 0;
+#if CANNY_NEON
+    for (; pos + 8 <= n; pos += 8) {
+        int16x8_t x = vld1q_s16(gx + pos);
+        int16x8_t y = vld1q_s16(gy + pos);
+        int32x4_t lo = vmlal_s16(vmull_s16(vget_low_s16(x), vget_low_s16(x)), vget_low_s16(y), vget_low_s16(y));
+        int32x4_t hi = vmlal_s16(vmull_s16(vget_high_s16(x), vget_high_s16(x)), vget_high_s16(y), vget_high_s16(y));
+        vst1q_u32(magsq + pos, vreinterpretq_u32_s32(lo));
+        vst1q_u32(magsq + pos + 4, vreinterpretq_u32_s32(hi));
+    }
+#endif
+    for (; pos < n; pos++) {
+        magsq[pos] = (unsigned int)(gx[pos] * gx[pos]) + (unsigned int)(gy[pos] * gy[pos]);
+    }
+}
+
+static inline unsigned int ISqrt(unsigned int x) {
+    unsigned int root = 0, bit = 1u << 30;
+    while (bit > x) bit >>= 2;
+    while (bit) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// Octant NMS: the gradient direction is bucketed into horizontal, vertical
+// or one of two diagonals with integer tan(22.5) / tan(67.5) comparisons,
+// and the pixel must beat the two neighbors along that direction. Candidate
+// magnitudes (integer sqrt) are written for hysteresis.
+template <class D>
+static void NonMaxSuppInt(D d, CannyBuffers* buf) {
+    const int rows = d.rows(), cols = d.cols();
+    const unsigned int* magsq = buf->magsq;
+    const short* gx = buf->delta_x;
+    const short* gy = buf->delta_y;
+    short* mag = buf->magnitude;
+    unsigned char* result = buf->nms;
+
+    // Neighbor offsets for: horizontal gradient, vertical, and the two
+    // diagonals (gx, gy same sign / opposite sign)
+    const int offset[4] = {1, cols, cols + 1, cols - 1};
+
+    memset(result, 0, cols);
+    memset(result + (rows - 1) * cols, 0, cols);
+    for (int r = 1; r < rows - 1; r++) {
+        result[r * cols] = 0;
+        result[r * cols + cols - 1] = 0;
+        for (int c = 1; c < cols - 1; c++) {
+            int pos = r * cols + c;
+            unsigned int m00 = magsq[pos];
+            if (m00 == 0) {
+                result[pos] = NOEDGE;
+                continue;
+            }
+            // Q16: tan(22.5) = 27146, tan(67.5) = 158217
+            int64_t ax = gx[pos] < 0 ? -gx[pos] : gx[pos];
+            int64_t ay = gy[pos] < 0 ? -gy[pos] : gy[pos];
+            int octant;
+            if ((ay << 16) <= 27146 * ax) {
+                octant = 0;
+            } else if ((ay << 16) >= 158217 * ax) {
+                octant = 1;
+            } else {
+                octant = ((gx[pos] ^ gy[pos]) >= 0) ? 2 : 3;
+            }
+            int o = offset[octant];
+            if (m00 > magsq[pos + o] && m00 >= magsq[pos - o]) {
+                result[pos] = POSSIBLE_EDGE;
+                mag[pos] = (short)ISqrt(m00);
+            } else {
+                result[pos] = NOEDGE;
+            }
+        }
+    }
+}
+
+template <class D>
+static void CannyIntIntoT(D d, const unsigned char* image, float sigma, float tlow, float thigh, unsigned char* edge,
+                          CannyBuffers* buf) {
+    MakeIntKernel(sigma, buf);
+    GaussianSmoothInt(d, image, buf);
+    DerivativeXY(d, buf);
+    MagnitudeSqXY(d, buf);
+    NonMaxSuppInt(d, buf);
+    // Hysteresis only reads the magnitude of NMS candidates
+    ApplyHysteresis(d, tlow, thigh, edge, buf);
+}
+
+// ---------------------------------------------------------------------------
+// Size selection
+
+template <int Rows, int Cols>
+static void CannyIntoFixed(const unsigned char* image, int, int, float sigma, float tlow, float thigh,
+                           unsigned char* edge, CannyBuffers* buf) {
+    CannyIntoT(FixedDims<Rows, Cols>(), image, sigma, tlow, thigh, edge, buf);
+}
+
+template <int Rows, int Cols>
+static void CannyIntIntoFixed(const unsigned char* image, int, int, float sigma, float tlow, float thigh,
+                              unsigned char* edge, CannyBuffers* buf) {
+    CannyIntIntoT(FixedDims<Rows, Cols>(), image, sigma, tlow, thigh, edge, buf);
+}
+
+static void CannyIntoGeneric(const unsigned char* image, int rows, int cols, float sigma, float tlow, float thigh,
+                             unsigned char* edge, CannyBuffers* buf) {
+    CannyIntoT(RuntimeDims{rows, cols}, image, sigma, tlow, thigh, edge, buf);
+}
+
+static void CannyIntIntoGeneric(const unsigned char* image, int rows, int cols, float sigma, float tlow, float thigh,
+                                unsigned char* edge, CannyBuffers* buf) {
+    CannyIntIntoT(RuntimeDims{rows, cols}, image, sigma, tlow, thigh, edge, buf);
+}
+
+struct CannyFixedSize {
+    int rows, cols;
+    CannyFn fn[2];  // by CannyMode
+};
+
+#define CANNY_FIXED_ENTRY(rows, cols) {rows, cols, {CannyIntoFixed<rows, cols>, CannyIntIntoFixed<rows, cols>}},
+static const CannyFixedSize kFixedSizes[] = {CANNY_FIXED_SIZES(CANNY_FIXED_ENTRY)};
+#undef CANNY_FIXED_ENTRY
+
+CannyFn CannySelect(CannyMode mode, int rows, int cols, bool* fixed) {
+    for (const CannyFixedSize& size : kFixedSizes) {
+        if (size.rows == rows && size.cols == cols) {
+            if (fixed) *fixed = true;
+            return size.fn[mode];
+        }
+    }
+    if (fixed) *fixed = false;
+    return mode == CANNY_INT ? CannyIntIntoGeneric : CannyIntoGeneric;
+}
+
+void CannyInto(const unsigned char* image, int rows, int cols, float sigma, float tlow, float thigh,
+               unsigned char* edge, CannyBuffers* buf) {
+    CannySelect(CANNY_FLOAT, rows, cols)(image, rows, cols, sigma, tlow, thigh, edge, buf);
+}
+
+void CannyIntInto(const unsigned char* image, int rows, int cols, float sigma, float tlow, float thigh,
+                  unsigned char* edge, CannyBuffers* buf) {
+    CannySelect(CANNY_INT, rows, cols)(image, rows, cols, sigma, tlow, thigh, edge, buf);
+}
+
+void CannyRun(CannyMode mode, const unsigned char* image, int rows, int cols, float sigma, float tlow, float thigh,
+              unsigned char* edge, CannyBuffers* buf) {
+    CannySelect(mode, rows, cols)(image, rows, cols, sigma, tlow, thigh, edge, buf);
+}
+
+// Self-check
+
+// A fresh scratch set for rows x cols; free() the returned memory
+static void* NewScratch(int rows, int cols, CannyBuffers* buf) {
+    size_t bytes = (CannyScratchBytes(rows, cols) + 63) & ~(size_t)63;
+    void* mem = aligned_alloc(64, bytes);
+    CannyBuffersInit(buf, rows, cols, mem);
+    return mem;
+}
+
+int CannySelfCheck() {
+    // The degrade path's order: kernels of two sigmas and both modes cached
+    // in, and rebuilt over, one scratch set
+    static const struct {
+        CannyMode mode;
+        float sigma;
+    } kSteps[] = {{CANNY_FLOAT, 1.0f}, {CANNY_INT, 0.6f}, {CANNY_FLOAT, 1.0f}, {CANNY_INT, 0.6f},
+                  {CANNY_INT, 1.0f},   {CANNY_FLOAT, 0.6f}, {CANNY_INT, 0.6f}};
+    static const int kSizes[][2] = {{480, 854}, {97, 131}};  // a fixed and a generic size
+    int failures = 0;
+    for (const auto& size : kSizes) {
+        int rows = size[0], cols = size[1];
+        size_t n = (size_t)rows * cols;
+        std::vector<unsigned char> image(n), edge(n), expect(n);
+        uint32_t seed = 12345;
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                seed = seed * 1103515245u + 12345u;
+                int dr = r - rows / 2, dc = c - cols / 3;
+                int disc = dr * dr + dc * dc < rows * rows / 9 ? 160 : 40;
+                image[(size_t)r * cols + c] = (unsigned char)(disc + (c * 64) / cols + (int)((seed >> 16) & 31));
+            }
+        }
+        CannyBuffers shared;
+        void* shared_mem = NewScratch(rows, cols, &shared);
+        for (const auto& step : kSteps) {
+            CannyBuffers fresh;
+            void* fresh_mem = NewScratch(rows, cols, &fresh);
+            CannyRun(step.mode, image.data(), rows, cols, step.sigma, 0.2f, 0.6f, expect.data(), &fresh);
+            free(fresh_mem);
+            CannyRun(step.mode, image.data(), rows, cols, step.sigma, 0.2f, 0.6f, edge.data(), &shared);
+            size_t differ = 0;
+            for (size_t i = 0; i < n; i++) differ += edge[i] != expect[i];
+            if (differ) {
+                printf("Canny check %dx%d: %s sigma %.2f after other kernels: %zu pixels differ from a fresh run\n",
+                       cols, rows, CannyModeName(step.mode), step.sigma, differ);
+                failures++;
+            }
+        }
+        free(shared_mem);
+    }
+    printf("Canny check: %s\n", failures ? "FAILED" : "ok");
+    return failures;
+}
@@ -0,0 +1,128 @@
+/**
+ * Canny edge detector writing into caller-supplied buffers.
+ *
+ * Same algorithm and parameters as canny() from canny_util (Gaussian blur,
+ * central-difference gradients, non-maximal suppression, hysteresis with
+ * thigh as a fraction of candidate pixels), but every intermediate image
+ * lives in a CannyBuffers set allocated once up front, so the per-frame
+ * path performs no heap allocation. Edge pixels are EDGE (0) on NOEDGE (255).
+ */
+#ifndef P3_CANNY_H
+#define P3_CANNY_H
+
+#include <math.h>
+#include <stddef.h>
+
+// NEON blur/gradient/magnitude kernels on aarch64; build with
+// -DCANNY_NEON=0 to force the scalar fallback
+#ifndef CANNY_NEON
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define CANNY_NEON 1
+#else
+#define CANNY_NEON 0
+#endif
+#endif
+
+#define NOEDGE 255
+#define POSSIBLE_EDGE 128
+#define EDGE 0
+
+#define CANNY_MAX_KERNEL 64  // supports sigma up to 12
+#define CANNY_MAX_MAG 32768
+
+// Float (canny_util compatible) or fixed-point arithmetic
+enum CannyMode { CANNY_FLOAT, CANNY_INT };
+
+// "float" / "int"; returns false for an unknown name
+bool CannyModeFromName(const char* name, CannyMode* mode);
+const char* CannyModeName(CannyMode mode);
+
+// Scratch images for one frame size; see FramePool for allocation
+struct CannyBuffers {
+    int rows, cols;
+    float kernel_sigma;  // sigma the cached kernel was built for
+    int kernel_size;
+    float kernel[CANNY_MAX_KERNEL];
+    float ikernel_sigma;  // same, for the Q8 kernel of the integer mode
+    int ikernel_size;     // own size: the float kernel may since be rebuilt
+    unsigned short ikernel[CANNY_MAX_KERNEL];
+    float* tempim;    // horizontal blur
+    // Integer mode aliases of tempim: the Q8 horizontal blur, then (once
+    // smoothing is done) the squared gradient magnitude
+    unsigned short* tempim16;
+    unsigned int* magsq;
+    short* smoothed;  // vertical blur, scaled by BOOSTBLURFACTOR
+    short* delta_x;
+    short* delta_y;
+    short* magnitude;
+    unsigned char* nms;
+    int* hist;   // CANNY_MAX_MAG entries
+    int* stack;  // rows * cols, hysteresis edge following
+};
+
+// Per-band scratch for the tiled path: the same images as CannyBuffers,
+// but only for one band of rows plus its halo
+struct CannyBand {
+    float* tempim;
+    short* smoothed;
+    short* delta_x;
+    short* delta_y;
+    short* magnitude;
+};
+
+// Halo rows a band needs on each side (blur radius, gradient and NMS)
+#define CANNY_BAND_HALO(sigma) (2 + (1 + 2 * (int)ceil(2.5 * (sigma))) / 2)
+
+// Bytes of scratch CannyBuffers needs for a rows x cols frame
+size_t CannyScratchBytes(int rows, int cols);
+
+// Carve the scratch images out of `mem` (at least CannyScratchBytes bytes,
+// 16-byte aligned)
+void CannyBuffersInit(CannyBuffers* buf, int rows, int cols, void* mem);
+
+// Detect edges of `image` (rows x cols, 8-bit gray) into `edge` (rows x cols)
+void CannyInto(const unsigned char* image, int rows, int cols, float sigma, float tlow, float thigh,
+               unsigned char* edge, CannyBuffers* buf);
+
+// Banded float pipeline, the building blocks of CannyInto and the tiled
+// mode: CannyPrepare() builds the kernel once per frame; CannyBandInto()
+// takes rows [r0, r1) through blur -> gradient -> NMS in `band` scratch
+// (rows r1 - r0 + 2 * CANNY_BAND_HALO) while they are cache resident,
+// writing buf->nms and buf->magnitude for those rows only, so disjoint
+// bands may run concurrently; CannyFinish() runs frame-wide hysteresis.
+void CannyPrepare(float sigma, CannyBuffers* buf);
+void CannyBandInto(const unsigned char* image, int rows, int cols, int r0, int r1, CannyBuffers* buf,
+                   CannyBand* band);
+void CannyFinish(int rows, int cols, float tlow, float thigh, unsigned char* edge, CannyBuffers* buf);
+
+// Integer mode, same API: Q8 Gaussian kernel, 16-bit gradients, squared
+// magnitudes compared in non-maximal suppression (no sqrtf), and an octant
+// lookup instead of interpolating along the gradient. Integer sqrt is taken
+// only for the surviving candidates to set the hysteresis thresholds.
+void CannyIntInto(const unsigned char* image, int rows, int cols, float sigma, float tlow, float thigh,
+                  unsigned char* edge, CannyBuffers* buf);
+
+// Whole-frame detector with the CannyInto() signature
+typedef void (*CannyFn)(const unsigned char* image, int rows, int cols, float sigma, float tlow, float thigh,
+                        unsigned char* edge, CannyBuffers* buf);
+
+// Frame sizes (rows, cols) with compile-time specialized kernels: fixed row
+// strides and loop bounds, so the compiler unrolls and vectorizes them
+#define CANNY_FIXED_SIZES(X) X(240, 320) X(480, 640) X(480, 854) X(720, 1280)
+
+// The detector for mode at rows x cols: a fixed-size instance for one of
+// CANNY_FIXED_SIZES (*fixed = true), otherwise the generic runtime-size
+// one. A fixed instance must only be called with that size. Select once per
+// stream; CannyInto(), CannyIntInto() and CannyRun() select per call.
+CannyFn CannySelect(CannyMode mode, int rows, int cols, bool* fixed = NULL);
+
+// Dispatch on mode and size
+void CannyRun(CannyMode mode, const unsigned char* image, int rows, int cols, float sigma, float tlow, float thigh,
+              unsigned char* edge, CannyBuffers* buf);
+
+// ./p3 --check: run both modes at two sigmas in turn on one scratch set,
+// as the degrade path does, and compare every frame with a fresh set's;
+// returns the number of mismatching runs
+int CannySelfCheck();
+
+#endif
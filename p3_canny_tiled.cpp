@@ -0,0 +1,169 @@
+#include "p3_canny_tiled.h"
+
+#include <string.h>
+
+#include <stdexcept>
+#include <string>
+
+#include "p3_framepool.h"
+#include "p3_thread.h"
+
+// Enough halo for the largest supported kernel
+#define MAX_HALO (2 + CANNY_MAX_KERNEL / 2)
+
+struct WorkerArg {
+    CannyTiled* tiled;
+    int index;
+};
+
+static size_t Align64(size_t n) { return (n + 63) & ~(size_t)63; }
+
+CannyTiled::CannyTiled(int rows, int cols, int band_rows, int workers, int policy, int priority,
+                       const cpu_set_t* cpus)
+    : rows_(rows), cols_(cols), band_rows_(band_rows > 0 ? band_rows : CANNY_DEFAULT_BAND_ROWS) {
+    num_bands_ = (rows_ + band_rows_ - 1) / band_rows_;
+
+    // Band scratch: one set per participant (caller + workers)
+    size_t n = (size_t)(band_rows_ + 2 * MAX_HALO) * cols;
+    size_t per_band = Align64(n * sizeof(float)) + 4 * Align64(n * sizeof(short));
+    band_bytes_ = per_band * (workers + 1);
+    band_mem_ = AllocLocked(band_bytes_, "CannyTiled");
+    char* p = static_cast<char*>(band_mem_);
+    for (int i = 0; i <= workers; i++) {
+        CannyBand band;
+        band.tempim = reinterpret_cast<float*>(p);
+        p += Align64(n * sizeof(float));
+        band.smoothed = reinterpret_cast<short*>(p);
+        p += Align64(n * sizeof(short));
+        band.delta_x = reinterpret_cast<short*>(p);
+        p += Align64(n * sizeof(short));
+        band.delta_y = reinterpret_cast<short*>(p);
+        p += Align64(n * sizeof(short));
+        band.magnitude = reinterpret_cast<short*>(p);
+        p += Align64(n * sizeof(short));
+        bands_.push_back(band);
+    }
+
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&start_cond_, NULL);
+    pthread_cond_init(&done_cond_, NULL);
+
+    for (int i = 0; i < workers; i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, policy);
+        sched_param param;
+        param.sched_priority = priority;
+        pthread_attr_setschedparam(&attr, &param);
+
+        // No destructor runs if we throw: stop the helpers already running
+        // (they hold `this`) and release everything before reporting
+        std::string error;
+        WorkerArg* arg = new WorkerArg{this, i + 1};
+        pthread_t thread;
+        try {
+            if (cpus) SetAttrAffinity(&attr, *cpus);
+            int ret = pthread_create(&thread, &attr, &CannyTiled::WorkerMain, arg);
+            if (ret) error = std::string("CannyTiled pthread_create failed: ") + strerror(ret);
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        pthread_attr_destroy(&attr);
+        if (!error.empty()) {
+            delete arg;
+            Shutdown();
+            throw std::runtime_error{error};
+        }
+        threads_.push_back(thread);
+    }
+}
+
+CannyTiled::~CannyTiled() { Shutdown(); }
+
+void CannyTiled::Shutdown() {
+    pthread_mutex_lock(&mutex_);
+    stop_ = true;
+    pthread_cond_broadcast(&start_cond_);
+    pthread_mutex_unlock(&mutex_);
+    for (pthread_t thread : threads_) pthread_join(thread, NULL);
+    threads_.clear();
+
+    pthread_cond_destroy(&done_cond_);
+    pthread_cond_destroy(&start_cond_);
+    pthread_mutex_destroy(&mutex_);
+    FreeLocked(band_mem_, band_bytes_);
+}
+
+CannyTiled* CannyTiled::ForCaller(const CannyTiling& tiling, int rows, int cols) {
+    if (tiling.band_rows <= 0) return NULL;
+    int policy;
+    sched_param param;
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    // SCHED_DEADLINE cannot be inherited through attrs; run helpers as FIFO 1
+    if (policy != SCHED_OTHER && policy != SCHED_FIFO && policy != SCHED_RR) {
+        policy = SCHED_FIFO;
+        param.sched_priority = 1;
+    }
+    return new CannyTiled(rows, cols, tiling.band_rows, tiling.workers, policy, param.sched_priority,
+                          tiling.pinned ? &tiling.cpus : NULL);
+}
+
+void CannyTiled::WorkBands(CannyBand* band) {
+    int b;
+    while ((b = next_band_.fetch_add(1, std::memory_order_relaxed)) < num_bands_) {
+        int r0 = b * band_rows_;
+        int r1 = r0 + band_rows_ < rows_ ? r0 + band_rows_ : rows_;
+        CannyBandInto(image_, rows_, cols_, r0, r1, buf_, band);
+    }
+}
+
+void* CannyTiled::WorkerMain(void* data) {
+    WorkerArg* arg = static_cast<WorkerArg*>(data);
+    CannyTiled* self = arg->tiled;
+    CannyBand* band = &self->bands_[arg->index];
+    delete arg;
+
+    unsigned seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&self->mutex_);
+        while (!self->stop_ && self->generation_ == seen) {
+            pthread_cond_wait(&self->start_cond_, &self->mutex_);
+        }
+        if (self->stop_) {
+            pthread_mutex_unlock(&self->mutex_);
+            return NULL;
+        }
+        seen = self->generation_;
+        pthread_mutex_unlock(&self->mutex_);
+
+        self->WorkBands(band);
+
+        pthread_mutex_lock(&self->mutex_);
+        if (++self->done_ == (int)self->threads_.size()) pthread_cond_signal(&self->done_cond_);
+        pthread_mutex_unlock(&self->mutex_);
+    }
+}
+
+void CannyTiled::Run(const unsigned char* image, float sigma, float tlow, float thigh, unsigned char* edge,
+                     CannyBuffers* buf) {
+    CannyPrepare(sigma, buf);
+
+    pthread_mutex_lock(&mutex_);
+    image_ = image;
+    buf_ = buf;
+    next_band_.store(0, std::memory_order_relaxed);
+    done_ = 0;
+    generation_++;
+    pthread_cond_broadcast(&start_cond_);
+    pthread_mutex_unlock(&mutex_);
+
+    // The caller takes bands too, so workers == 0 is plain tiling
+    WorkBands(&bands_[0]);
+
+    pthread_mutex_lock(&mutex_);
+    while (done_ < (int)threads_.size()) pthread_cond_wait(&done_cond_, &mutex_);
+    pthread_mutex_unlock(&mutex_);
+
+    CannyFinish(rows_, cols_, tlow, thigh, edge, buf);
+}
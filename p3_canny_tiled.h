@@ -0,0 +1,78 @@
+/**
+ * Tiled, cache-blocked canny (float mode).
+ *
+ * The frame is cut into horizontal bands of `band_rows` rows. Each band goes
+ * through blur -> gradient -> NMS in its own small scratch while it is still
+ * in L2 (halo rows are recomputed at band edges), then frame-wide hysteresis
+ * runs once. With workers > 0 the bands are shared between the calling
+ * thread and a persistent team of worker threads, which sleep on a condition
+ * variable between frames. Output is identical to CannyInto().
+ */
+#ifndef P3_CANNY_TILED_H
+#define P3_CANNY_TILED_H
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <vector>
+
+#include "p3_canny.h"
+
+#define CANNY_DEFAULT_BAND_ROWS 16
+
+// Tiling as configured per experiment thread/stage; band_rows == 0 keeps
+// the whole-frame CannyRun() path
+struct CannyTiling {
+    int band_rows = 0;
+    int workers = 0;      // helper threads besides the caller
+    bool pinned = false;  // false = workers inherit no CPU mask
+    cpu_set_t cpus;
+};
+
+class CannyTiled {
+   public:
+    // Workers are created with the given scheduling policy/priority (e.g.
+    // the caller's own) and CPU mask (NULL = any CPU).
+    // Throws std::runtime_error if scratch or threads cannot be created.
+    CannyTiled(int rows, int cols, int band_rows, int workers, int policy = SCHED_OTHER, int priority = 0,
+               const cpu_set_t* cpus = NULL);
+    ~CannyTiled();
+
+    CannyTiled(const CannyTiled&) = delete;
+    CannyTiled& operator=(const CannyTiled&) = delete;
+
+    // Same contract as CannyInto(); buf supplies the frame-wide nms,
+    // magnitude and hysteresis scratch
+    void Run(const unsigned char* image, float sigma, float tlow, float thigh, unsigned char* edge,
+             CannyBuffers* buf);
+
+    int workers() const { return (int)threads_.size(); }
+
+    // Builds a team whose workers use the calling thread's own policy and
+    // priority; NULL when tiling is off
+    static CannyTiled* ForCaller(const CannyTiling& tiling, int rows, int cols);
+
+   private:
+    static void* WorkerMain(void* data);
+    void WorkBands(CannyBand* band);
+    void Shutdown();  // stop and join the workers, free the scratch
+
+    int rows_, cols_, band_rows_, num_bands_;
+    size_t band_bytes_;
+    void* band_mem_;
+    std::vector<CannyBand> bands_;  // one scratch set per participant
+    std::vector<pthread_t> threads_;
+
+    // Current frame, published under mutex_ by bumping generation_
+    const unsigned char* image_ = NULL;
+    CannyBuffers* buf_ = NULL;
+    std::atomic<int> next_band_{0};
+    pthread_mutex_t mutex_;
+    pthread_cond_t start_cond_, done_cond_;
+    unsigned generation_ = 0;
+    int done_ = 0;
+    bool stop_ = false;
+};
+
+#endif
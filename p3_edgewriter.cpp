@@ -0,0 +1,341 @@
+#include "p3_edgewriter.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <stdexcept>
+
+#include "canny_util.h"
+#include "p3_thread.h"
+
+#if P3_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define BATCH_BUFFER_BYTES (1 << 20)
+
+bool EdgeSinkFromName(const char* name, EdgeSink* sink) {
+    if (strcmp(name, "pgm") == 0) {
+        *sink = SINK_PGM;
+    } else if (strcmp(name, "batch") == 0) {
+        *sink = SINK_BATCH;
+    } else if (strcmp(name, "uring") == 0) {
+        *sink = SINK_URING;
+    } else if (strcmp(name, "discard") == 0) {
+        *sink = SINK_DISCARD;
+    } else if (strcmp(name, "mmap") == 0) {
+        *sink = SINK_MMAP;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* EdgeSinkName(EdgeSink sink) {
+    switch (sink) {
+        case SINK_BATCH:
+            return "batch";
+        case SINK_URING:
+            return "uring";
+        case SINK_DISCARD:
+            return "discard";
+        case SINK_MMAP:
+            return "mmap";
+        default:
+            return "pgm";
+    }
+}
+
+#if P3_IO_URING
+// Just enough of an io_uring instance for ordered appends: one SQ/CQ pair
+// mapped from the kernel, and a writev (header + frame) per slot
+struct UringQueue {
+    int fd = -1;
+    void* sq_ring = MAP_FAILED;
+    void* cq_ring = MAP_FAILED;
+    size_t sq_bytes = 0, cq_bytes = 0, sqe_bytes = 0;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+    io_uring_cqe* cqes;
+    struct iovec iov[EDGEWRITER_SLOTS][2];
+
+    ~UringQueue() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqe_bytes);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_bytes);
+        if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_bytes);
+        if (fd >= 0) close(fd);
+    }
+};
+
+static int UringEnter(int fd, unsigned submit, unsigned wait) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+bool EdgeWriter::OpenUring() {
+    std::unique_ptr<UringQueue> q(new UringQueue());
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    q->fd = (int)syscall(__NR_io_uring_setup, EDGEWRITER_SLOTS, &p);
+    if (q->fd < 0) {
+        printf("Edge writer: io_uring_setup failed (%s), using batch\n", strerror(errno));
+        return false;
+    }
+
+    q->sq_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    q->cq_bytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (q->cq_bytes > q->sq_bytes) q->sq_bytes = q->cq_bytes;
+    }
+    q->sq_ring = mmap(NULL, q->sq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, q->fd, IORING_OFF_SQ_RING);
+    if (q->sq_ring == MAP_FAILED) return false;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        q->cq_ring = q->sq_ring;
+    } else {
+        q->cq_ring =
+            mmap(NULL, q->cq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, q->fd, IORING_OFF_CQ_RING);
+        if (q->cq_ring == MAP_FAILED) return false;
+    }
+    q->sqe_bytes = p.sq_entries * sizeof(io_uring_sqe);
+    q->sqes = (io_uring_sqe*)mmap(NULL, q->sqe_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, q->fd,
+                                  IORING_OFF_SQES);
+    if (q->sqes == MAP_FAILED) return false;
+
+    char* sq = static_cast<char*>(q->sq_ring);
+    char* cq = static_cast<char*>(q->cq_ring);
+    q->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    q->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    q->sq_array = (unsigned*)(sq + p.sq_off.array);
+    q->cq_head = (unsigned*)(cq + p.cq_off.head);
+    q->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    q->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    q->cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+    uring_ = q.release();
+    return true;
+}
+
+// Recycle the slots of completed writes; wait blocks for at least one
+void EdgeWriter::ReapUring(bool wait) {
+    UringQueue* q = uring_;
+    if (wait && inflight_ > 0) UringEnter(q->fd, 0, 1);
+    unsigned head = *q->cq_head;
+    unsigned tail = __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const io_uring_cqe& cqe = q->cqes[head & *q->cq_mask];
+        int slot = (int)cqe.user_data;
+        if (cqe.res < 0 || (size_t)cqe.res != (size_t)header_len_ + (size_t)rows_ * cols_) {
+            errors_++;
+        } else {
+            written_++;
+        }
+        inflight_--;
+        free_.Push(slot);
+    }
+    __atomic_store_n(q->cq_head, head, __ATOMIC_RELEASE);
+}
+#else
+struct UringQueue {};
+#endif
+
+EdgeWriter::EdgeWriter(const EdgeOutput& output, int rows, int cols, const std::string& prefix, bool thread)
+    : sink_(output.sink), rows_(rows), cols_(cols), prefix_(prefix) {
+    // The mmap sink writes with plain stores from the producer; the page
+    // cache does the I/O, so there is nothing for a thread to do
+    if (sink_ == SINK_MMAP) {
+        ring_.reset(new RawFrameRing(prefix_ + "_ring.raw", rows, cols, EDGEWRITER_RING_FRAMES));
+        open_ = true;
+        return;
+    }
+
+    slots_.reset(new FramePool(EDGEWRITER_SLOTS, rows, cols, false));
+    for (int i = 0; i < EDGEWRITER_SLOTS; i++) free_.Push(i);
+    header_len_ = snprintf(header_, sizeof(header_), "P5\n%d %d\n255\n", cols, rows);
+
+    // Files are opened here, before the RT loop, so the first frame pays
+    // no open() either
+#if P3_IO_URING
+    if (sink_ == SINK_URING && !OpenUring()) sink_ = SINK_BATCH;
+#else
+    if (sink_ == SINK_URING) {
+        printf("Edge writer: built without io_uring, using batch\n");
+        sink_ = SINK_BATCH;
+    }
+#endif
+    if (sink_ == SINK_BATCH || sink_ == SINK_URING) {
+        std::string path = prefix_ + "_batch.pgm";
+        file_ = fopen(path.c_str(), "wb");
+        if (!file_) throw std::runtime_error{"cannot open " + path + ": " + strerror(errno)};
+        if (sink_ == SINK_BATCH) {
+            file_buf_ = new char[BATCH_BUFFER_BYTES];
+            setvbuf(file_, file_buf_, _IOFBF, BATCH_BUFFER_BYTES);
+        }
+    }
+
+    if (!thread) {
+        open_ = true;
+        return;
+    }
+
+    // The writer is plain SCHED_OTHER even when created from an RT thread,
+    // which would otherwise pass its policy on
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    sched_param param;
+    param.sched_priority = 0;
+    pthread_attr_setschedparam(&attr, &param);
+    if (output.pinned) SetAttrAffinity(&attr, output.cpus);
+    int ret = pthread_create(&thread_, &attr, &EdgeWriter::WriterMain, this);
+    pthread_attr_destroy(&attr);
+    if (ret) throw std::runtime_error{std::string("EdgeWriter pthread_create failed: ") + strerror(ret)};
+    open_ = true;
+    threaded_ = true;
+}
+
+EdgeWriter::~EdgeWriter() {
+    Close();
+    if (file_) fclose(file_);
+    delete[] file_buf_;
+    delete uring_;
+}
+
+int EdgeWriter::Acquire() {
+    if (ring_) return next_ % ring_->frames();  // overwrites the oldest
+    int slot;
+    if (!free_.Pop(&slot)) return -1;
+    return slot;
+}
+
+void EdgeWriter::Submit(int slot, int seq) {
+    if (ring_) {
+        ring_->Commit(next_++);
+        written_++;
+        return;
+    }
+    Item item = {slot, seq};
+    // Cannot fail: at most EDGEWRITER_SLOTS slots exist
+    queued_.Push(item);
+}
+
+void EdgeWriter::End() {
+    Item end = {-1, 0};
+    queued_.PushWait(end);
+}
+
+void EdgeWriter::Serve() { Loop(); }
+
+void EdgeWriter::Close() {
+    if (!open_) return;
+    if (threaded_) {
+        End();
+        pthread_join(thread_, NULL);
+    }
+    open_ = false;
+    if (file_) fflush(file_);
+    if (sink_ == SINK_DISCARD) {
+        printf("Edge writer (discard): %d frames discarded, %d dropped\n", discarded_, dropped_);
+    } else {
+        printf("Edge writer (%s): %d frames, %d dropped, %d errors\n", EdgeSinkName(sink_), written_, dropped_,
+               errors_);
+    }
+}
+
+void* EdgeWriter::WriterMain(void* data) {
+    static_cast<EdgeWriter*>(data)->Loop();
+    return NULL;
+}
+
+void EdgeWriter::Loop() {
+    int spins = 0;
+    for (;;) {
+        Item item;
+        if (!queued_.Pop(&item)) {
+#if P3_IO_URING
+            // Nothing queued: wait on completions rather than backing off
+            if (inflight_ > 0) {
+                ReapUring(true);
+                continue;
+            }
+#endif
+            RingBackoff(&spins);
+            continue;
+        }
+        spins = 0;
+        if (item.slot < 0) break;
+        WriteItem(item);
+    }
+#if P3_IO_URING
+    while (inflight_ > 0) ReapUring(true);
+#endif
+}
+
+void EdgeWriter::WriteItem(const Item& item) {
+    unsigned char* edge = slots_->frame(item.slot);
+    size_t bytes = (size_t)rows_ * cols_;
+    switch (sink_) {
+        case SINK_PGM: {
+            char outfilename[256];
+            snprintf(outfilename, sizeof(outfilename), "%s_%d.pgm", prefix_.c_str(), item.seq);
+            if (write_pgm_image(outfilename, edge, rows_, cols_, NULL, 255) == 0) {
+                fprintf(stderr, "Error writing the edge image, %s.\n", outfilename);
+                errors_++;
+            } else {
+                written_++;
+            }
+            break;
+        }
+        case SINK_BATCH:
+            if (fwrite(header_, 1, header_len_, file_) != (size_t)header_len_ || fwrite(edge, 1, bytes, file_) != bytes) {
+                errors_++;
+            } else {
+                written_++;
+            }
+            break;
+#if P3_IO_URING
+        case SINK_URING: {
+            // Frames land at consecutive offsets, so the container keeps
+            // submission order even if completions do not
+            UringQueue* q = uring_;
+            q->iov[item.slot][0].iov_base = header_;
+            q->iov[item.slot][0].iov_len = header_len_;
+            q->iov[item.slot][1].iov_base = edge;
+            q->iov[item.slot][1].iov_len = bytes;
+
+            unsigned tail = *q->sq_tail;
+            unsigned index = tail & *q->sq_mask;
+            io_uring_sqe* sqe = &q->sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->fd = fileno(file_);
+            sqe->off = offset_;
+            sqe->addr = (unsigned long)q->iov[item.slot];
+            sqe->len = 2;
+            sqe->user_data = item.slot;
+            q->sq_array[index] = index;
+            __atomic_store_n(q->sq_tail, tail + 1, __ATOMIC_RELEASE);
+            int ret;
+            while ((ret = UringEnter(q->fd, 1, 0)) < 0 && (errno == EINTR || errno == EAGAIN)) {
+            }
+            if (ret < 0) {
+                // Not consumed by the kernel: take the entry back
+                __atomic_store_n(q->sq_tail, tail, __ATOMIC_RELEASE);
+                errors_++;
+                break;
+            }
+            offset_ += header_len_ + bytes;
+            inflight_++;
+            ReapUring(false);
+            return;  // the slot comes back on completion
+        }
+#endif
+        default:
+            discarded_++;
+            break;
+    }
+    free_.Push(item.slot);
+}
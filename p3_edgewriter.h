@@ -0,0 +1,137 @@
+/**
+ * Asynchronous edge-image output for CannyP3.
+ *
+ * The canny loop fills a locked slot from Acquire() and hands it to
+ * Submit(); a separate SCHED_OTHER writer thread owns every filesystem call
+ * (filename formatting, open/write/close) and returns the slot through a
+ * second SPSC ring. When the writer falls behind, Acquire() fails and the
+ * frame is counted as dropped instead of blocking the RT thread. A writer
+ * built without a thread is driven by whichever thread calls Serve(), as
+ * the pipeline's write stage does.
+ *
+ * Sinks:
+ *   pgm     - one <prefix>_<seq>.pgm per frame, as write_pgm_image() did
+ *   batch   - every frame appended to <prefix>_batch.pgm (a multi-image
+ *             netpbm stream) through one large stdio buffer
+ *   uring   - the same container written with io_uring, up to
+ *             EDGEWRITER_SLOTS writes in flight straight from the slots;
+ *             falls back to batch when io_uring is unavailable
+ *   discard - frames are recycled unwritten and counted as discarded, to
+ *             benchmark pure compute
+ *   mmap    - no writer thread: slots are the frames of a mapped
+ *             <prefix>_ring.raw (RawFrameRing, EDGEWRITER_RING_FRAMES
+ *             deep) and the kernel writes them back in the background
+ */
+#ifndef P3_EDGEWRITER_H
+#define P3_EDGEWRITER_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+
+#include "p3_framepool.h"
+#include "p3_rawframes.h"
+#include "p3_ring.h"
+
+#define EDGEWRITER_SLOTS 8         // queued frames (power of two)
+#define EDGEWRITER_RING_FRAMES 32  // slots in the mmap sink's output file
+
+// io_uring through raw syscalls (no liburing); build with -DP3_IO_URING=0
+// to compile the uring sink out
+#ifndef P3_IO_URING
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define P3_IO_URING 1
+#else
+#define P3_IO_URING 0
+#endif
+#endif
+
+enum EdgeSink { SINK_PGM, SINK_BATCH, SINK_URING, SINK_DISCARD, SINK_MMAP };
+
+bool EdgeSinkFromName(const char* name, EdgeSink* sink);
+const char* EdgeSinkName(EdgeSink sink);
+
+// Output as configured per experiment thread
+struct EdgeOutput {
+    EdgeSink sink = SINK_PGM;
+    bool pinned = false;  // false = writer inherits the creating thread's mask
+    bool given = false;   // edge_cpus set; else CheckExperiment() uses NrtCpus()
+    cpu_set_t cpus;
+};
+
+struct UringQueue;
+
+class EdgeWriter {
+   public:
+    // prefix names the output files, e.g. "camera_s_1.00_l_0.20_h_0.60".
+    // Without `thread` no writer thread is started (output.cpus is unused)
+    // and another thread must Serve(). Throws std::runtime_error if slots,
+    // files or the thread cannot be set up.
+    EdgeWriter(const EdgeOutput& output, int rows, int cols, const std::string& prefix, bool thread = true);
+    ~EdgeWriter();  // Close()s if still open
+
+    EdgeWriter(const EdgeWriter&) = delete;
+    EdgeWriter& operator=(const EdgeWriter&) = delete;
+
+    // Producer side (one thread): a free slot or -1 if the writer is behind
+    int Acquire();
+    unsigned char* frame(int slot) { return ring_ ? ring_->frame(slot) : slots_->frame(slot); }
+    void Submit(int slot, int seq);
+    void Drop() { dropped_++; }
+    void End();  // no more Submit(); Serve() returns once the queue is drained
+
+    // Writer side for a writer built without a thread: runs the writer loop
+    // on the calling thread until the producer's End()
+    void Serve();
+
+    // Drains queued frames, joins the writer and prints a summary line; call
+    // after Serve() returns when there is no writer thread
+    void Close();
+
+   private:
+    struct Item {
+        int slot;  // < 0 ends the stream
+        int seq;
+    };
+
+    static void* WriterMain(void* data);
+    void Loop();
+    void WriteItem(const Item& item);
+#if P3_IO_URING
+    bool OpenUring();
+    void ReapUring(bool wait);
+#endif
+
+    EdgeSink sink_;
+    int rows_, cols_;
+    std::string prefix_;
+    std::unique_ptr<FramePool> slots_;
+    std::unique_ptr<RawFrameRing> ring_;  // mmap sink only
+    int next_ = 0;
+    SpscRing<Item, EDGEWRITER_SLOTS> queued_;
+    SpscRing<int, EDGEWRITER_SLOTS> free_;
+    pthread_t thread_;
+    bool open_ = false;
+    bool threaded_ = false;
+
+    // Container sinks; header_ is the per-frame netpbm header
+    FILE* file_ = NULL;
+    char* file_buf_ = NULL;
+    char header_[32];
+    int header_len_ = 0;
+
+    UringQueue* uring_ = NULL;
+    int inflight_ = 0;
+    long long offset_ = 0;
+
+    // Producer-side and writer-side counters, read after the join
+    int dropped_ = 0;
+    int written_ = 0;
+    int discarded_ = 0;
+    int errors_ = 0;
+};
+
+#endif
@@ -0,0 +1,538 @@
+#include "p3_experiment.h"
+
+#include <sched.h>
+#include <stdio.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "p3_sched.h"
+#include "p3_workload.h"
+
+// The original hard-coded experiments, expressed in the experiment format
+static const char* kBuiltinExperiments[] = {
+    // 0
+    "[experiment]\n"
+    "description = Experiment 1: One CannyP3 APP (RT) and Two any-type APPs (NRT), All running on CPU=1\n"
+    "[thread]\nclass = rt\npolicy = fifo\npriority = 80\ncpus = 1\nworkload = canny\n"
+    "[thread]\nclass = nrt\ncpus = 1\n"
+    "[thread]\nclass = nrt\ncpus = 1\n",
+    // 1
+    "[experiment]\n"
+    "description = Experiment 2: Same workload as 1, but freely run on available CPUs\n"
+    "[thread]\nclass = rt\npolicy = fifo\npriority = 80\nworkload = canny\n"
+    "[thread]\nclass = nrt\n"
+    "[thread]\nclass = nrt\n",
+    // 2
+    "[experiment]\n"
+    "description = Experiment 3: Two any-type APPs (same priority, SCHED_FIFO) in RT and One any-type APP (NRT), "
+    "All running on CPU=1\n"
+    "[thread]\nclass = rt\npolicy = fifo\npriority = 80\ncpus = 1\n"
+    "[thread]\nclass = rt\npolicy = fifo\npriority = 80\ncpus = 1\n"
+    "[thread]\nclass = nrt\ncpus = 1\n",
+    // 3
+    "[experiment]\n"
+    "description = Experiment 4: Two any-type APPs (same priority, SCHED_RR) in RT and One any-type APP (NRT), "
+    "All running on CPU=1\n"
+    "[thread]\nclass = rt\npolicy = rr\npriority = 80\ncpus = 1\n"
+    "[thread]\nclass = rt\npolicy = rr\npriority = 80\ncpus = 1\n"
+    "[thread]\nclass = nrt\ncpus = 1\n",
+    // 4
+    "[experiment]\n"
+    "description = Experiment 5: Same workload as 3, but freely run on available CPUs\n"
+    "[thread]\nclass = rt\npolicy = fifo\npriority = 80\n"
+    "[thread]\nclass = rt\npolicy = fifo\npriority = 80\n"
+    "[thread]\nclass = nrt\n",
+    // 5
+    "[experiment]\n"
+    "description = Experiment 6: One periodic CannyP3 APP (RT, 30 fps, SCHED_FIFO) and Two any-type APPs (NRT)\n"
+    "[thread]\nclass = rt\npolicy = fifo\npriority = 80\nworkload = canny\nperiod_us = 33333\ncycles = 100\n"
+    "[thread]\nclass = nrt\n"
+    "[thread]\nclass = nrt\n",
+    // 6
+    "[experiment]\n"
+    "description = Experiment 7: Pipelined CannyP3, canny stage in RT (SCHED_FIFO 80) on CPU=2, "
+    "capture/gray/write in NRT on CPUs 0, 1 and 3\n"
+    "[stage]\nname = capture\nclass = nrt\ncpus = 0\n"
+    "[stage]\nname = gray\nclass = nrt\ncpus = 1\n"
+    "[stage]\nname = canny\nclass = rt\npolicy = fifo\npriority = 80\ncpus = 2\n"
+    "[stage]\nname = write\nclass = nrt\ncpus = 3\n",
+};
+
+static const char* kStageNames[NUM_STAGES] = {"capture", "gray", "canny", "write"};
+
+int PipelineStageFromName(const std::string& name) {
+    for (int s = 0; s < NUM_STAGES; s++) {
+        if (name == kStageNames[s]) return s;
+    }
+    return -1;
+}
+
+const char* PipelineStageName(int stage) { return kStageNames[stage]; }
+
+static std::string Trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t\r");
+    if (b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r");
+    return s.substr(b, e - b + 1);
+}
+
+static long ParseLong(const std::string& value, const std::string& where) {
+    size_t used = 0;
+    long v;
+    try {
+        v = std::stol(value, &used);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    if (used == 0 || used != value.size()) {
+        throw std::runtime_error{where + ": expected an integer, got '" + value + "'"};
+    }
+    return v;
+}
+
+bool ParseCpuList(const std::string& text, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        item = Trim(item);
+        int first, last;
+        char extra;
+        if (sscanf(item.c_str(), "%d-%d%c", &first, &last, &extra) == 2) {
+        } else if (sscanf(item.c_str(), "%d%c", &first, &extra) == 1) {
+            last = first;
+        } else {
+            return false;
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) return false;
+        for (int cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, cpus);
+        }
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+
+std::string FormatCpuList(const cpu_set_t& cpus) {
+    std::string out;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &cpus)) continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus)) last++;
+        if (!out.empty()) out += ",";
+        out += std::to_string(cpu);
+        if (last > cpu) out += "-" + std::to_string(last);
+        cpu = last;
+    }
+    return out;
+}
+
+cpu_set_t StreamCpu(const ThreadSpec& t) {
+    int cpu = -1;
+    for (int i = 0; i <= t.stream % CPU_COUNT(&t.cpus); i++) {
+        do {
+            cpu++;
+        } while (!CPU_ISSET(cpu, &t.cpus));
+    }
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    return one;
+}
+
+// Pinned CPUs of an RT app or stage, including its helper threads
+static void AddRtCpus(const ThreadSpec& t, cpu_set_t* cpus) {
+    if (t.cls != THREAD_RT) return;
+    if (t.pinned) {
+        cpu_set_t own = t.stream >= 0 ? StreamCpu(t) : t.cpus;
+        CPU_OR(cpus, cpus, &own);
+    }
+    if (t.canny_tiling.pinned) CPU_OR(cpus, cpus, &t.canny_tiling.cpus);
+    if (t.workload == "pool-jobs" && t.pool.pinned) CPU_OR(cpus, cpus, &t.pool.cpus);
+}
+
+cpu_set_t RtCpus(const ExperimentSpec& spec) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (const ThreadSpec& t : spec.threads) AddRtCpus(t, &cpus);
+    for (const ThreadSpec& t : spec.stages) AddRtCpus(t, &cpus);
+    return cpus;
+}
+
+cpu_set_t NrtCpus(const ExperimentSpec& spec) {
+    cpu_set_t all, cpus;
+    if (sched_getaffinity(0, sizeof(all), &all) != 0) {
+        CPU_ZERO(&all);
+        CPU_SET(0, &all);
+    }
+    cpus = all;
+
+    // isolcpus= cores are meant for the RT side even when nothing is pinned yet
+    std::ifstream file("/sys/devices/system/cpu/isolated");
+    std::string isolated;
+    cpu_set_t iso;
+    if (std::getline(file, isolated) && ParseCpuList(Trim(isolated), &iso)) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &iso)) CPU_CLR(cpu, &cpus);
+        }
+    }
+
+    cpu_set_t rt = RtCpus(spec);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &rt)) CPU_CLR(cpu, &cpus);
+    }
+    return CPU_COUNT(&cpus) > 0 ? cpus : all;
+}
+
+const char* ThreadClassName(ThreadClass cls) {
+    static const char* names[] = {"rt", "nrt", "stress"};
+    return names[cls];
+}
+
+void SetThreadKey(ThreadSpec* t, const std::string& key, const std::string& value, const std::string& where) {
+    if (key == "class") {
+        if (value == "rt") {
+            t->cls = THREAD_RT;
+        } else if (value == "nrt") {
+            t->cls = THREAD_NRT;
+        } else if (value == "stress") {
+            t->cls = THREAD_STRESS;
+        } else {
+            throw std::runtime_error{where + ": class must be rt, nrt or stress"};
+        }
+    } else if (key == "policy") {
+        if (value == "fifo") {
+            t->policy = SCHED_FIFO;
+        } else if (value == "rr") {
+            t->policy = SCHED_RR;
+        } else if (value == "deadline") {
+            t->policy = SCHED_DEADLINE;
+        } else {
+            throw std::runtime_error{where + ": unknown policy '" + value + "'"};
+        }
+    } else if (key == "priority") {
+        t->priority = (int)ParseLong(value, where);
+    } else if (key == "cpus") {
+        if (value == "any") {
+            t->pinned = false;
+        } else if (ParseCpuList(value, &t->cpus)) {
+            t->pinned = true;
+        } else {
+            throw std::runtime_error{where + ": malformed CPU list '" + value + "'"};
+        }
+    } else if (key == "workload") {
+        if (!FindWorkload(value)) {
+            throw std::runtime_error{where + ": unknown workload '" + value + "' (" + WorkloadNames() + ")"};
+        }
+        t->workload = value;
+    } else if (key == "busy_flavor") {
+        if (!BusyFlavorFromName(value.c_str(), &t->busy.flavor)) {
+            throw std::runtime_error{where + ": busy_flavor must be alu, fp or mem"};
+        }
+    } else if (key == "busy_us") {
+        t->busy.work_us = ParseLong(value, where);
+        if (t->busy.work_us <= 0) throw std::runtime_error{where + ": busy_us must be > 0"};
+    } else if (key == "busy_kb") {
+        t->busy.mem_kb = ParseLong(value, where);
+        if (t->busy.mem_kb <= 0) throw std::runtime_error{where + ": busy_kb must be > 0"};
+    } else if (key == "lock") {
+        if (value.empty()) throw std::runtime_error{where + ": lock needs a name"};
+        t->lock = value;
+    } else if (key == "lock_protocol") {
+        if (!MutexProtocolFromName(value.c_str(), &t->lock_protocol)) {
+            throw std::runtime_error{where + ": lock_protocol must be none, inherit or protect"};
+        }
+    } else if (key == "lock_ceiling") {
+        t->lock_ceiling = (int)ParseLong(value, where);
+        if (t->lock_ceiling < 1 || t->lock_ceiling > 99) throw std::runtime_error{where + ": lock_ceiling must be 1..99"};
+    } else if (key == "pool_workers") {
+        t->pool.workers = (int)ParseLong(value, where);
+        if (t->pool.workers < 1) throw std::runtime_error{where + ": pool_workers must be >= 1"};
+    } else if (key == "pool_jobs") {
+        t->pool.jobs = (int)ParseLong(value, where);
+        if (t->pool.jobs < 1 || t->pool.jobs > RTPOOL_QUEUE) {
+            throw std::runtime_error{where + ": pool_jobs must be 1.." + std::to_string(RTPOOL_QUEUE)};
+        }
+    } else if (key == "pool_cpus") {
+        if (value == "any") {
+            t->pool.pinned = false;
+        } else if (ParseCpuList(value, &t->pool.cpus)) {
+            t->pool.pinned = true;
+        } else {
+            throw std::runtime_error{where + ": malformed CPU list '" + value + "'"};
+        }
+    } else if (key == "canny_mode") {
+        if (!CannyModeFromName(value.c_str(), &t->canny_mode)) {
+            throw std::runtime_error{where + ": canny_mode must be float or int"};
+        }
+    } else if (key == "canny_bands") {
+        t->canny_tiling.band_rows = (int)ParseLong(value, where);
+        if (t->canny_tiling.band_rows < 0) throw std::runtime_error{where + ": canny_bands must be >= 0"};
+    } else if (key == "canny_workers") {
+        t->canny_tiling.workers = (int)ParseLong(value, where);
+        if (t->canny_tiling.workers < 0) throw std::runtime_error{where + ": canny_workers must be >= 0"};
+    } else if (key == "canny_cpus") {
+        if (value == "any") {
+            t->canny_tiling.pinned = false;
+        } else if (ParseCpuList(value, &t->canny_tiling.cpus)) {
+            t->canny_tiling.pinned = true;
+        } else {
+            throw std::runtime_error{where + ": malformed CPU list '" + value + "'"};
+        }
+    } else if (key == "edge_output") {
+        if (!EdgeSinkFromName(value.c_str(), &t->edge_output.sink)) {
+            throw std::runtime_error{where + ": edge_output must be pgm, batch, uring, discard or mmap"};
+        }
+    } else if (key == "edge_cpus") {
+        t->edge_output.given = true;
+        if (value == "any") {
+            t->edge_output.pinned = false;
+        } else if (ParseCpuList(value, &t->edge_output.cpus)) {
+            t->edge_output.pinned = true;
+        } else {
+            throw std::runtime_error{where + ": malformed CPU list '" + value + "'"};
+        }
+    } else if (key == "input_raw") {
+        t->input_raw = value;
+    } else if (key == "camera") {
+        t->camera = value;
+    } else if (key == "period_us") {
+        t->period_us = ParseLong(value, where);
+    } else if (key == "deadline_us") {
+        t->deadline_us = ParseLong(value, where);
+    } else if (key == "overrun") {
+        if (!OverrunPolicyFromName(value.c_str(), &t->overrun)) {
+            throw std::runtime_error{where + ": overrun must be log, skip or degrade"};
+        }
+    } else if (key == "cycles") {
+        t->cycles = (int)ParseLong(value, where);
+    } else if (key == "runtime_us") {
+        t->runtime_us = ParseLong(value, where);
+    } else if (key == "name") {
+        if (PipelineStageFromName(value) < 0) throw std::runtime_error{where + ": unknown stage '" + value + "'"};
+        t->name = value;
+    } else if (key == "streams") {
+        t->streams = (int)ParseLong(value, where);
+        if (t->streams < 1 || t->streams > 64) throw std::runtime_error{where + ": streams must be 1..64"};
+        t->stream = -1;
+    } else if (key == "app_id") {
+        t->app_id = (int)ParseLong(value, where);
+    } else {
+        throw std::runtime_error{where + ": unknown key '" + key + "'"};
+    }
+}
+
+// Banding only exists for the float path
+static void CheckCannyTiling(const ThreadSpec& t, const std::string& where) {
+    if (t.canny_tiling.band_rows > 0 && t.canny_mode != CANNY_FLOAT) {
+        throw std::runtime_error{where + ": canny_bands needs canny_mode = float"};
+    }
+    if (t.canny_tiling.band_rows == 0 && (t.canny_tiling.workers > 0 || t.canny_tiling.pinned)) {
+        throw std::runtime_error{where + ": canny_workers/canny_cpus need canny_bands"};
+    }
+}
+
+// One copy per stream of every not yet expanded `streams` group, in place;
+// an explicit app_id numbers the streams from there
+static void ExpandStreams(std::vector<ThreadSpec>* threads) {
+    std::vector<ThreadSpec> out;
+    for (const ThreadSpec& t : *threads) {
+        if (t.streams == 0 || t.stream >= 0) {
+            out.push_back(t);
+            continue;
+        }
+        for (int i = 0; i < t.streams; i++) {
+            out.push_back(t);
+            out.back().stream = i;
+            if (t.app_id != 0) out.back().app_id = t.app_id + i;
+        }
+    }
+    *threads = out;
+}
+
+void CheckExperiment(ExperimentSpec* spec, const std::string& origin) {
+    if (spec->threads.empty() && spec->stages.empty()) {
+        throw std::runtime_error{origin + ": no [thread] or [stage] sections"};
+    }
+    for (const ThreadSpec& t : spec->stages) {
+        if (t.streams > 0) throw std::runtime_error{origin + ": streams is only valid in [thread]"};
+    }
+    if (spec->metrics_port > 0 && spec->metrics.empty()) {
+        throw std::runtime_error{origin + ": metrics_port requires metrics = <shared memory name>"};
+    }
+    ExpandStreams(&spec->threads);
+    bool seen[NUM_STAGES] = {false};
+    for (const ThreadSpec& t : spec->stages) {
+        int s = PipelineStageFromName(t.name);
+        if (s < 0) throw std::runtime_error{origin + ": [stage] without a name"};
+        if (seen[s]) throw std::runtime_error{origin + ": duplicate stage '" + t.name + "'"};
+        if (t.period_us > 0 && t.policy != SCHED_DEADLINE) {
+            throw std::runtime_error{origin + ": stage '" + t.name + "' cannot be periodic"};
+        }
+        CheckCannyTiling(t, origin + ": stage '" + t.name + "'");
+        if (t.cls == THREAD_STRESS) throw std::runtime_error{origin + ": class = stress is only valid in [thread]"};
+        if (!t.input_raw.empty() && s != STAGE_CAPTURE) {
+            throw std::runtime_error{origin + ": input_raw belongs on the capture stage"};
+        }
+        seen[s] = true;
+    }
+
+    // Writer threads stay off the RT cores unless edge_cpus says otherwise;
+    // inheriting the app's mask would put them behind a FIFO loop
+    cpu_set_t nrt = NrtCpus(*spec);
+    for (ThreadSpec& t : spec->threads) {
+        if (t.edge_output.given) continue;
+        t.edge_output.pinned = true;
+        t.edge_output.cpus = nrt;
+    }
+
+    // App ids default to the thread's position, as in the original banners
+    for (size_t i = 0; i < spec->threads.size(); i++) {
+        ThreadSpec& t = spec->threads[i];
+        if (t.app_id == 0) t.app_id = (int)i + 1;
+        std::string app = origin + ": app #" + std::to_string(t.app_id);
+        if (t.cls != THREAD_RT && t.period_us > 0) {
+            throw std::runtime_error{app + ": periodic mode is RT only"};
+        }
+        CheckCannyTiling(t, app);
+        if (!t.camera.empty() && !t.input_raw.empty()) {
+            throw std::runtime_error{app + ": camera and input_raw are exclusive"};
+        }
+        if (t.cls == THREAD_RT && t.policy == SCHED_DEADLINE && (t.runtime_us <= 0 || t.period_us <= 0)) {
+            throw std::runtime_error{app + ": SCHED_DEADLINE needs runtime_us and period_us"};
+        }
+        if (t.workload == "shared-lock" && t.lock_protocol == MUTEX_PROTECT) {
+            // glibc raises a ceiling holder with sched_setparam() under its own
+            // policy, which fails for SCHED_OTHER and SCHED_DEADLINE
+            if (t.cls != THREAD_RT || t.policy == SCHED_DEADLINE) {
+                throw std::runtime_error{app + ": lock_protocol = protect needs a fifo/rr thread"};
+            }
+            if (t.priority > t.lock_ceiling) throw std::runtime_error{app + ": priority above lock_ceiling"};
+        }
+        if (t.streams > 0) {
+            if (t.cls != THREAD_RT || t.workload != "canny") {
+                throw std::runtime_error{app + ": streams needs an rt thread with workload = canny"};
+            }
+            // One decode (./p3 --decode) and one mapping for every stream
+            if (t.input_raw.empty()) throw std::runtime_error{app + ": streams needs input_raw"};
+        }
+        if (t.workload == "canny-batch") {
+            if (t.input_raw.empty()) throw std::runtime_error{app + ": canny-batch needs input_raw"};
+            if (t.cls == THREAD_RT) throw std::runtime_error{app + ": canny-batch is an NRT workload"};
+        }
+    }
+}
+
+ExperimentSpec ParseExperiment(const std::string& text, const std::string& origin) {
+    ExperimentSpec spec;
+    std::istringstream in(text);
+    std::string line, section;
+    int lineno = 0;
+
+    while (std::getline(in, line)) {
+        lineno++;
+        std::string where = origin + ":" + std::to_string(lineno);
+
+        // Comments: '#' or ';' at the start of a line, or ';' after whitespace
+        for (size_t i = 0; i < line.size(); i++) {
+            if ((i == 0 && line[i] == '#') || (line[i] == ';' && (i == 0 || line[i - 1] == ' ' || line[i - 1] == '\t'))) {
+                line.erase(i);
+                break;
+            }
+        }
+        line = Trim(line);
+        if (line.empty()) continue;
+
+        if (line.front() == '[') {
+            if (line.back() != ']') throw std::runtime_error{where + ": unterminated section"};
+            section = Trim(line.substr(1, line.size() - 2));
+            if (section == "thread") {
+                spec.threads.push_back(ThreadSpec());
+                spec.threads.back().policy = SCHED_FIFO;
+            } else if (section == "stage") {
+                spec.stages.push_back(ThreadSpec());
+                spec.stages.back().policy = SCHED_FIFO;
+            } else if (section != "experiment") {
+                throw std::runtime_error{where + ": unknown section [" + section + "]"};
+            }
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) throw std::runtime_error{where + ": expected key = value"};
+        std::string key = Trim(line.substr(0, eq));
+        std::string value = Trim(line.substr(eq + 1));
+
+        if (section == "experiment") {
+            if (key == "description") {
+                spec.description = value;
+            } else if (key == "trace") {
+                spec.trace = value;
+            } else if (key == "heap_reserve_mb") {
+                spec.heap_reserve_mb = ParseLong(value, where);
+                if (spec.heap_reserve_mb < 0) throw std::runtime_error{where + ": heap_reserve_mb must be >= 0"};
+            } else if (key == "steal_workers") {
+                spec.steal_workers = value == "auto" ? -1 : (int)ParseLong(value, where);
+                if (spec.steal_workers < -1) throw std::runtime_error{where + ": steal_workers must be >= 0 or auto"};
+            } else if (key == "steal_cpus") {
+                if (!ParseCpuList(value, &spec.steal_cpus)) {
+                    throw std::runtime_error{where + ": malformed CPU list '" + value + "'"};
+                }
+                spec.steal_pinned = true;
+            } else if (key == "preflight") {
+                if (!PreflightModeFromName(value, &spec.preflight)) {
+                    throw std::runtime_error{where + ": preflight must be off, warn or enforce"};
+                }
+            } else if (key == "metrics") {
+                spec.metrics = value;
+            } else if (key == "metrics_port") {
+                spec.metrics_port = (int)ParseLong(value, where);
+                if (spec.metrics_port < 0 || spec.metrics_port > 65535) {
+                    throw std::runtime_error{where + ": metrics_port must be 0..65535"};
+                }
+            } else if (key == "thermal_ms") {
+                spec.thermal_ms = (int)ParseLong(value, where);
+                if (spec.thermal_ms < 0) throw std::runtime_error{where + ": thermal_ms must be >= 0"};
+            } else if (key == "preflight_skip") {
+                std::stringstream in(value);
+                std::string check;
+                while (std::getline(in, check, ',')) {
+                    check = Trim(check);
+                    if (!IsPreflightCheck(check)) throw std::runtime_error{where + ": unknown preflight check '" + check + "'"};
+                    spec.preflight_skip.push_back(check);
+                }
+            } else {
+                throw std::runtime_error{where + ": unknown key '" + key + "'"};
+            }
+        } else if (section == "thread") {
+            if (key == "name") throw std::runtime_error{where + ": name is only valid in [stage]"};
+            SetThreadKey(&spec.threads.back(), key, value, where);
+        } else if (section == "stage") {
+            if (key == "camera") throw std::runtime_error{where + ": camera is only valid in [thread]"};
+            SetThreadKey(&spec.stages.back(), key, value, where);
+        } else {
+            throw std::runtime_error{where + ": key outside of a section"};
+        }
+    }
+
+    CheckExperiment(&spec, origin);
+    return spec;
+}
+
+ExperimentSpec LoadExperimentFile(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) throw std::runtime_error{"cannot open experiment file " + path};
+    std::stringstream text;
+    text << file.rdbuf();
+    return ParseExperiment(text.str(), path);
+}
+
+int NumBuiltinExperiments() { return sizeof(kBuiltinExperiments) / sizeof(kBuiltinExperiments[0]); }
+
+ExperimentSpec BuiltinExperiment(int exp_id) {
+    if (exp_id < 0 || exp_id >= NumBuiltinExperiments()) {
+        throw std::runtime_error{"exp_id NOT FOUND"};
+    }
+    return ParseExperiment(kBuiltinExperiments[exp_id], "builtin:" + std::to_string(exp_id));
+}
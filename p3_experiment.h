@@ -0,0 +1,179 @@
+/**
+ * Data-driven experiment descriptions.
+ *
+ * An experiment is an INI file with one [experiment] section and one
+ * [thread] section per app, e.g.
+ *
+ *   [experiment]
+ *   description = One RT + two NRT apps, all on CPU=1
+ *   trace = trace.json  ; optional per-thread event trace (p3_trace.h)
+ *   heap_reserve_mb = 64 ; heap touched by RT init (RtProcessInit); 0 = none
+ *   steal_workers = auto ; NRT work-stealing runtime (p3_steal.h): 0 = off,
+ *                        ; N workers, or auto = one per NrtCpus() core
+ *   steal_cpus = 2-3     ; CPUs for those workers instead of NrtCpus()
+ *   preflight = warn     ; off | warn | enforce  RT host checks (p3_preflight.h)
+ *   preflight_skip = governor, irq_affinity ; checks to leave out
+ *   metrics = /p3        ; live counters in this shared memory object (p3_metrics.h)
+ *   metrics_port = 9464  ; Prometheus exporter for them; 0 = none
+ *   thermal_ms = 100     ; cpufreq/thermal sampling period (p3_thermal.h); 0 = off
+ *
+ *   [thread]
+ *   class = rt          ; rt | nrt | stress
+ *                       ; (stress: NRT app repeating its workload from
+ *                       ;  before the first app starts until the last ends)
+ *   policy = fifo       ; fifo | rr | deadline   (rt only)
+ *   priority = 80       ;             (fifo/rr only)
+ *   cpus = 1            ; CPU list such as 1, 2-3 or 0,2-3; or "any"
+ *   workload = busycal  ; busycal | canny | memory-stream | syscall-heavy | cache-thrash
+ *                       ; | shared-lock | fork-exec | file-io | net-loopback
+ *                       ; | timer-storm | pool-jobs | canny-batch
+ *   busy_flavor = alu   ; alu | fp | mem     (busycal workload)
+ *   busy_us = 1000000   ; calibrated on-CPU microseconds per BusyCal unit
+ *   busy_kb = 8192      ; mem flavor buffer size
+ *   lock = frameq       ; shared mutex taken around each unit (shared-lock)
+ *   lock_protocol = inherit ; none | inherit | protect (p3_sync.h)
+ *   lock_ceiling = 90   ; SCHED_FIFO ceiling for protect
+ *   pool_workers = 2    ; persistent RT workers (pool-jobs, p3_workerpool.h)
+ *   pool_jobs = 8       ; busy_us jobs dispatched to them per unit
+ *   pool_cpus = 2-3     ; one CPU per worker, round robin; or "any"
+ *   canny_mode = float  ; float | int   (canny workload / canny stage)
+ *   canny_bands = 16    ; rows per cache-blocked band, 0 = whole frame
+ *   canny_workers = 2   ; band helper threads besides the app itself
+ *   canny_cpus = 2-3    ; CPU list for the helpers, or "any"
+ *   edge_output = pgm   ; pgm | batch | uring | discard | mmap
+ *                       ; (async writer thread, or a mapped output ring)
+ *   edge_cpus = 0       ; CPU list for the writer thread, or "any" for the
+ *                       ; app's own mask (default: NrtCpus())
+ *   input_raw = ground_crew_480p.raw  ; mmap'd frames from ./p3 --decode
+ *                       ; (required by canny-batch, which spreads them over
+ *                       ;  the steal_workers runtime)
+ *   camera = /dev/video0                ; live V4L2 capture ([thread] only)
+ *   streams = 4         ; rt canny only: N independent streams, one app
+ *                       ; each, pinned one CPU each round robin over `cpus`;
+ *                       ; they share one input_raw mapping (required)
+ *   period_us = 33333   ; optional periodic mode (rt only)
+ *   deadline_us = 0     ; defaults to the period
+ *   overrun = log       ; log | skip | degrade  on a deadline miss (p3_overrun.h)
+ *   cycles = 100        ; 0 = until the workload ends
+ *   runtime_us = 8000   ; SCHED_DEADLINE budget per period (deadline only,
+ *                       ; which also requires period_us)
+ *
+ * Optional [stage] sections run CannyP3 as a staged pipeline (see
+ * p3_pipeline.h); each takes the thread keys above plus
+ *
+ *   name = canny        ; capture | gray | canny | write
+ *
+ * Built-in experiments 0..N are kept in the same format so `./p3 <id>`
+ * and `./p3 -f file.ini` share one code path.
+ */
+#ifndef P3_EXPERIMENT_H
+#define P3_EXPERIMENT_H
+
+#include <sched.h>
+
+#include <string>
+#include <vector>
+
+#include "p3_busycal.h"
+#include "p3_canny_tiled.h"
+#include "p3_edgewriter.h"
+#include "p3_overrun.h"
+#include "p3_preflight.h"
+#include "p3_sync.h"
+#include "p3_workerpool.h"
+
+enum ThreadClass { THREAD_RT, THREAD_NRT, THREAD_STRESS };
+
+// "rt" / "nrt" / "stress"
+const char* ThreadClassName(ThreadClass cls);
+
+enum PipelineStage { STAGE_CAPTURE, STAGE_GRAY, STAGE_CANNY, STAGE_WRITE, NUM_STAGES };
+
+// Stage names as used by [stage] name = ...; -1 if unknown
+int PipelineStageFromName(const std::string& name);
+const char* PipelineStageName(int stage);
+
+struct ThreadSpec {
+    int app_id = 0;
+    ThreadClass cls = THREAD_NRT;
+    int policy = 0;  // SCHED_FIFO / SCHED_RR / SCHED_DEADLINE for RT threads
+    int priority = 80;
+    bool pinned = false;  // false = any CPU
+    cpu_set_t cpus;
+    std::string workload = "busycal";
+    BusySpec busy;
+    std::string lock = "shared";  // shared-lock workload
+    MutexProtocol lock_protocol = MUTEX_NONE;
+    int lock_ceiling = 99;
+    WorkerPoolSpec pool;  // pool-jobs workload
+    CannyMode canny_mode = CANNY_FLOAT;
+    CannyTiling canny_tiling;
+    EdgeOutput edge_output;
+    std::string input_raw;  // pre-decoded frames (--decode); empty = video
+    std::string camera;     // V4L2 device such as /dev/video0 ([thread] only)
+    int streams = 0;        // > 0: one of `streams` canny streams copied from one [thread]
+    int stream = -1;        // index within that group, set by CheckExperiment()
+    long period_us = 0;
+    long deadline_us = 0;
+    OverrunPolicy overrun = OVERRUN_LOG;
+    int cycles = 0;
+    long runtime_us = 0;  // SCHED_DEADLINE only
+    std::string name;     // pipeline stage name ([stage] sections only)
+};
+
+struct ExperimentSpec {
+    std::string description;
+    std::vector<ThreadSpec> threads;
+    std::vector<ThreadSpec> stages;  // empty unless CannyP3 runs as a pipeline
+    std::string trace;               // Chrome trace output path; empty = off
+    long heap_reserve_mb = 64;       // RtProcessInit heap reserve
+    int steal_workers = 0;           // NRT work-stealing runtime: 0 = off, -1 = auto
+    bool steal_pinned = false;       // steal_cpus given; otherwise NrtCpus()
+    cpu_set_t steal_cpus;
+    PreflightMode preflight = PREFLIGHT_WARN;
+    std::vector<std::string> preflight_skip;  // check names (p3_preflight.h)
+    std::string metrics;                      // shared memory name; empty = off
+    int metrics_port = 0;                     // Prometheus exporter, needs metrics
+    int thermal_ms = 100;                     // ThermalSampler period; 0 = off
+};
+
+// Parse a CPU list ("1", "2-3", "0,2-3") into a mask; false if malformed
+bool ParseCpuList(const std::string& text, cpu_set_t* cpus);
+
+// Format a mask back as a compact CPU list
+std::string FormatCpuList(const cpu_set_t& cpus);
+
+// A `streams` app's own core: stream i takes the i-th CPU of its cpus,
+// wrapping around (t.pinned and t.stream >= 0)
+cpu_set_t StreamCpu(const ThreadSpec& t);
+
+// Every CPU an RT app, stage or RT helper thread is pinned to (may be empty)
+cpu_set_t RtCpus(const ExperimentSpec& spec);
+
+// CPUs left for NRT work: the process affinity minus the kernel's isolated
+// CPUs and every CPU an RT app, stage or helper is pinned to (all of the
+// affinity if that leaves none)
+cpu_set_t NrtCpus(const ExperimentSpec& spec);
+
+// Parse INI text; `origin` names the source in error messages.
+// Throws std::runtime_error on malformed input.
+ExperimentSpec ParseExperiment(const std::string& text, const std::string& origin);
+
+// Set one [thread]/[stage] key, as the parser does; `where` prefixes errors.
+// Throws std::runtime_error.
+void SetThreadKey(ThreadSpec* t, const std::string& key, const std::string& value, const std::string& where);
+
+// Cross-key checks run after parsing; also expands `streams` groups into
+// one thread per stream and numbers apps whose app_id is 0 by position.
+// Throws std::runtime_error.
+void CheckExperiment(ExperimentSpec* spec, const std::string& origin);
+
+// Read and parse an experiment file. Throws std::runtime_error.
+ExperimentSpec LoadExperimentFile(const std::string& path);
+
+// Number of built-in experiments, and the one with the given id.
+// Throws std::runtime_error for an unknown id.
+int NumBuiltinExperiments();
+ExperimentSpec BuiltinExperiment(int exp_id);
+
+#endif
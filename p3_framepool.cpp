@@ -0,0 +1,48 @@
+#include "p3_framepool.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <stdexcept>
+#include <string>
+
+static size_t PageAlign(size_t n) { return (n + 4095) & ~(size_t)4095; }
+
+void* AllocLocked(size_t bytes, const char* what) {
+    // MAP_POPULATE prefaults every page; mlock keeps them resident even
+    // without mlockall(MCL_FUTURE)
+    bytes = PageAlign(bytes);
+    void* mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (mem == MAP_FAILED) {
+        throw std::runtime_error{std::string(what) + " mmap failed: " + strerror(errno)};
+    }
+    if (mlock(mem, bytes)) {
+        int err = errno;
+        munmap(mem, bytes);
+        throw std::runtime_error{std::string(what) + " mlock failed: " + strerror(err)};
+    }
+    return mem;
+}
+
+void FreeLocked(void* mem, size_t bytes) {
+    bytes = PageAlign(bytes);
+    munlock(mem, bytes);
+    munmap(mem, bytes);
+}
+
+FramePool::FramePool(int frames, int rows, int cols, bool canny_scratch)
+    : frames_(frames), rows_(rows), cols_(cols), has_scratch_(canny_scratch) {
+    // Page-align each frame so frames never share a cache line or page
+    frame_bytes_ = PageAlign((size_t)rows * cols);
+    size_t scratch_bytes = canny_scratch ? PageAlign(CannyScratchBytes(rows, cols)) : 0;
+    bytes_ = frame_bytes_ * frames + scratch_bytes;
+
+    arena_ = AllocLocked(bytes_, "FramePool");
+
+    unsigned char* base = static_cast<unsigned char*>(arena_);
+    if (canny_scratch) CannyBuffersInit(&scratch_, rows, cols, base);
+    frames_base_ = base + scratch_bytes;
+}
+
+FramePool::~FramePool() { FreeLocked(arena_, bytes_); }
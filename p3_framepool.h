@@ -0,0 +1,47 @@
+/**
+ * Preallocated, page-locked frame and canny scratch buffers.
+ *
+ * One anonymous mapping holds `frames` frame buffers of rows x cols bytes
+ * plus, optionally, one CannyBuffers scratch set. The mapping is populated and mlock'ed
+ * at construction, so the steady-state frame loop never allocates or
+ * page-faults. Buffers are handed out by index; callers (rings, streams)
+ * decide who owns which index.
+ */
+#ifndef P3_FRAMEPOOL_H
+#define P3_FRAMEPOOL_H
+
+#include <stddef.h>
+
+#include "p3_canny.h"
+
+// Populated, mlock'ed anonymous memory for other preallocated buffers.
+// Throws std::runtime_error; `what` names the owner in the message.
+void* AllocLocked(size_t bytes, const char* what);
+void FreeLocked(void* mem, size_t bytes);
+
+class FramePool {
+   public:
+    // Throws std::runtime_error if the mapping cannot be created or locked
+    FramePool(int frames, int rows, int cols, bool canny_scratch = true);
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    unsigned char* frame(int i) { return frames_base_ + (size_t)i * frame_bytes_; }
+    int frames() const { return frames_; }
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    CannyBuffers* scratch() { return has_scratch_ ? &scratch_ : NULL; }
+
+   private:
+    int frames_, rows_, cols_;
+    size_t frame_bytes_;
+    size_t bytes_;
+    void* arena_;
+    unsigned char* frames_base_;
+    bool has_scratch_;
+    CannyBuffers scratch_;
+};
+
+#endif
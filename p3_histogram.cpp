@@ -0,0 +1,49 @@
+#include "p3_histogram.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+void LatencyHistogram::Reset() {
+    // memset also prefaults every page of the bucket array
+    memset(buckets_, 0, sizeof(buckets_));
+    overflow_ = 0;
+    count_ = 0;
+    min_ns_ = 0;
+    max_ns_ = 0;
+    sum_ns_ = 0;
+}
+
+double LatencyHistogram::Percentile(double p) const {
+    if (count_ == 0) return 0;
+    uint64_t target = (uint64_t)ceil(p * count_);
+    if (target == 0) target = 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += buckets_[b];
+        double edge_us = (b + 1) * (bucket_ns_ / 1000.0);
+        if (seen >= target) return edge_us < max_us() ? edge_us : max_us();
+    }
+    // Quantile falls into the overflow bucket
+    return max_us();
+}
+
+void LatencyHistogram::Print(int app_id) const {
+    char label[32];
+    snprintf(label, sizeof(label), "App #%d latency", app_id);
+    Print(label);
+}
+
+void LatencyHistogram::Print(const char* label) const {
+    if (count_ == 0) {
+        printf("%s: no samples\n", label);
+        return;
+    }
+    printf("%s (us): min %.1f, avg %.1f, p99 %.0f, p99.9 %.0f, max %.1f (%llu samples", label, min_us(), avg_us(),
+           Percentile(0.99), Percentile(0.999), max_us(), (unsigned long long)count_);
+    if (overflow_) {
+        printf(", %llu over %ld us", (unsigned long long)overflow_, HIST_BUCKETS * bucket_ns_ / 1000);
+    }
+    printf(")\n");
+}
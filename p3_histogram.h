@@ -0,0 +1,60 @@
+/**
+ * Fixed-size wakeup-latency histogram (cyclictest style).
+ *
+ * All storage lives inside the object and is touched by the constructor,
+ * so Record() on the RT hot path never allocates or page-faults.
+ */
+#ifndef P3_HISTOGRAM_H
+#define P3_HISTOGRAM_H
+
+#include <stdint.h>
+
+/* HIST_BUCKETS buckets of bucket_us each (1us by default, i.e. 0..10ms);
+   anything above is overflow */
+#define HIST_BUCKETS 10000
+
+class LatencyHistogram {
+   public:
+    explicit LatencyHistogram(long bucket_us = 1) : bucket_ns_(bucket_us * 1000) { Reset(); }
+
+    void Reset();
+
+    void Record(long latency_ns) {
+        if (latency_ns < 0) latency_ns = 0;
+        long bucket = latency_ns / bucket_ns_;
+        if (bucket < HIST_BUCKETS) {
+            buckets_[bucket]++;
+        } else {
+            overflow_++;
+        }
+        if (count_ == 0 || latency_ns < min_ns_) min_ns_ = latency_ns;
+        if (latency_ns > max_ns_) max_ns_ = latency_ns;
+        sum_ns_ += latency_ns;
+        count_++;
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t overflow() const { return overflow_; }
+    double min_us() const { return min_ns_ / 1000.0; }
+    double max_us() const { return max_ns_ / 1000.0; }
+    double avg_us() const { return count_ ? sum_ns_ / 1000.0 / count_ : 0; }
+
+    // Upper edge (us) of the bucket holding the p-th quantile, 0 < p <= 1
+    double Percentile(double p) const;
+
+    // "App #N latency (us): min .. avg .. p99 .. p99.9 .. max .."
+    void Print(int app_id) const;
+    // Same line with a caller-chosen label in place of "App #N latency"
+    void Print(const char* label) const;
+
+   private:
+    long bucket_ns_;
+    uint32_t buckets_[HIST_BUCKETS];
+    uint64_t overflow_;
+    uint64_t count_;
+    long min_ns_;
+    long max_ns_;
+    int64_t sum_ns_;
+};
+
+#endif
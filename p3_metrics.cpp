@@ -0,0 +1,320 @@
+#include "p3_metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+#include "p3_experiment.h"
+#include "p3_thread.h"
+#include "p3_timing.h"
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "metrics slots need lock-free 64-bit atomics");
+
+const long kMetricsBucketUs[METRICS_BUCKETS - 1] = {5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000};
+
+thread_local MetricsSlot* g_metrics_self = NULL;
+
+static MetricsPage* g_page = NULL;
+static std::string g_name;
+
+void MetricsOpen(const std::string& name, const std::string& description) {
+    if (name.size() < 2 || name[0] != '/' || name.find('/', 1) != std::string::npos) {
+        throw std::runtime_error{"metrics: '" + name + "' is not a shared memory name such as /p3"};
+    }
+    shm_unlink(name.c_str());  // left behind by a run that was killed
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) throw std::runtime_error{"metrics: shm_open " + name + ": " + strerror(errno)};
+    if (ftruncate(fd, sizeof(MetricsPage)) != 0) {
+        int err = errno;
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error{"metrics: ftruncate " + name + ": " + strerror(err)};
+    }
+    void* map = mmap(NULL, sizeof(MetricsPage), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw std::runtime_error{"metrics: mmap " + name + ": " + strerror(errno)};
+    }
+
+    // A fresh object is zero-filled; only the header needs values
+    g_page = static_cast<MetricsPage*>(map);
+    g_page->version = METRICS_VERSION;
+    g_page->pid = getpid();
+    g_page->start_ns = TimingNowNs();
+    snprintf(g_page->description, sizeof(g_page->description), "%s", description.c_str());
+    std::atomic_thread_fence(std::memory_order_release);
+    g_page->magic = METRICS_MAGIC;
+    g_name = name;
+    printf("Metrics: %s (%zu bytes)\n", name.c_str(), sizeof(MetricsPage));
+}
+
+void MetricsClose() {
+    if (!g_page) return;
+    MetricsStopServing();
+    munmap(g_page, sizeof(MetricsPage));
+    shm_unlink(g_name.c_str());
+    g_page = NULL;
+}
+
+bool MetricsEnabled() { return g_page != NULL; }
+
+MetricsSlot* MetricsClaim(int app_id, const char* cls, const std::string& workload) {
+    if (!g_page) return NULL;
+    uint32_t i = g_page->slots_used.load(std::memory_order_relaxed);
+    if (i >= METRICS_SLOTS) {
+        if (i == METRICS_SLOTS) printf("Metrics: more than %d threads, App #%d not exported\n", METRICS_SLOTS, app_id);
+        g_page->slots_used.store(METRICS_SLOTS + 1, std::memory_order_relaxed);
+        return NULL;
+    }
+    MetricsSlot* slot = &g_page->slots[i];
+    slot->app_id = app_id;
+    snprintf(slot->cls, sizeof(slot->cls), "%s", cls);
+    snprintf(slot->workload, sizeof(slot->workload), "%s", workload.c_str());
+    slot->cpu.store(-1, std::memory_order_relaxed);
+    // Published after the labels, so readers never see a half-named slot
+    g_page->slots_used.store(i + 1, std::memory_order_release);
+    return slot;
+}
+
+static uint32_t SlotsUsed(const MetricsPage& page) {
+    uint32_t n = page.slots_used.load(std::memory_order_acquire);
+    return n < METRICS_SLOTS ? n : METRICS_SLOTS;
+}
+
+std::string MetricsPrometheus(const MetricsPage& page) {
+    std::string out;
+    char line[256];
+    auto metric = [&](const char* name, const char* type, const char* help) {
+        snprintf(line, sizeof(line), "# HELP p3_%s %s\n# TYPE p3_%s %s\n", name, help, name, type);
+        out += line;
+    };
+
+    metric("run_seconds", "gauge", "Time since the run started.");
+    snprintf(line, sizeof(line), "p3_run_seconds %.3f\n", (TimingNowNs() - page.start_ns) * 1e-9);
+    out += line;
+
+    uint32_t n = SlotsUsed(page);
+    char labels[160];
+    auto each = [&](const char* name, const char* type, const char* help, auto value) {
+        metric(name, type, help);
+        for (uint32_t i = 0; i < n; i++) {
+            const MetricsSlot& s = page.slots[i];
+            snprintf(labels, sizeof(labels), "app=\"%d\",class=\"%s\",workload=\"%s\"", s.app_id, s.cls, s.workload);
+            out += "p3_" + std::string(name) + "{" + labels + "} " + value(s) + "\n";
+        }
+    };
+    auto u64 = [](uint64_t v) { return std::to_string(v); };
+    const auto relaxed = std::memory_order_relaxed;
+
+    each("thread_running", "gauge", "1 while the thread runs its workload.",
+         [&](const MetricsSlot& s) { return u64(s.state.load(relaxed) == METRICS_RUNNING); });
+    each("thread_cpu", "gauge", "CPU the thread last ran a cycle on, -1 if unknown.",
+         [&](const MetricsSlot& s) { return std::to_string(s.cpu.load(relaxed)); });
+    each("thread_cycles_total", "counter", "Periodic cycles completed.",
+         [&](const MetricsSlot& s) { return u64(s.cycles.load(relaxed)); });
+    each("thread_overruns_total", "counter", "Periodic cycles that missed their deadline.",
+         [&](const MetricsSlot& s) { return u64(s.overruns.load(relaxed)); });
+    each("thread_frames_total", "counter", "CannyP3 frames processed.",
+         [&](const MetricsSlot& s) { return u64(s.frames.load(relaxed)); });
+    each("thread_wakeup_latency_max_seconds", "gauge", "Worst wakeup latency so far.",
+         [&](const MetricsSlot& s) { return std::to_string(s.latency_max_ns.load(relaxed) * 1e-9); });
+
+    metric("thread_wakeup_latency_seconds", "histogram", "Periodic release to wakeup latency.");
+    for (uint32_t i = 0; i < n; i++) {
+        const MetricsSlot& s = page.slots[i];
+        snprintf(labels, sizeof(labels), "app=\"%d\",class=\"%s\",workload=\"%s\"", s.app_id, s.cls, s.workload);
+        uint64_t cumulative = 0;
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            cumulative += s.buckets[b].load(relaxed);
+            if (b < METRICS_BUCKETS - 1) {
+                snprintf(line, sizeof(line), "p3_thread_wakeup_latency_seconds_bucket{%s,le=\"%g\"} %llu\n", labels,
+                         kMetricsBucketUs[b] * 1e-6, (unsigned long long)cumulative);
+            } else {
+                snprintf(line, sizeof(line), "p3_thread_wakeup_latency_seconds_bucket{%s,le=\"+Inf\"} %llu\n", labels,
+                         (unsigned long long)cumulative);
+            }
+            out += line;
+        }
+        snprintf(line, sizeof(line), "p3_thread_wakeup_latency_seconds_sum{%s} %.9f\n", labels,
+                 s.latency_sum_ns.load(relaxed) * 1e-9);
+        out += line;
+        snprintf(line, sizeof(line), "p3_thread_wakeup_latency_seconds_count{%s} %llu\n", labels,
+                 (unsigned long long)cumulative);
+        out += line;
+    }
+    return out;
+}
+
+// Exporter: one SCHED_OTHER thread, one connection at a time. The poll()
+// timeout bounds how long MetricsStopServing() waits for it.
+static int g_listen_fd = -1;
+static pthread_t g_exporter;
+static std::atomic<bool> g_exporter_stop{false};
+
+static void ServeOne(int fd) {
+    // The request itself is ignored: every path gets the metrics
+    struct timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char request[2048];
+    if (recv(fd, request, sizeof(request), 0) <= 0) return;
+
+    std::string body = MetricsPrometheus(*g_page);
+    char header[160];
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n"
+                       "Connection: close\r\n\r\n",
+                       body.size());
+    std::string response = std::string(header, len) + body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return;
+        sent += n;
+    }
+}
+
+static void* ExporterMain(void*) {
+    struct pollfd pfd = {g_listen_fd, POLLIN, 0};
+    while (!g_exporter_stop.load(std::memory_order_acquire)) {
+        if (poll(&pfd, 1, 200) <= 0) continue;
+        int fd = accept(g_listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        ServeOne(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+void MetricsServe(int port, const cpu_set_t& cpus) {
+    if (!g_page) throw std::runtime_error{"metrics: metrics_port needs the metrics page"};
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw std::runtime_error{std::string("metrics: socket: ") + strerror(errno)};
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::runtime_error{"metrics: port " + std::to_string(port) + ": " + strerror(err)};
+    }
+    g_listen_fd = fd;
+    g_exporter_stop.store(false);
+
+    // Plain SCHED_OTHER on the NRT cores, whatever the caller runs as
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    sched_param param;
+    param.sched_priority = 0;
+    pthread_attr_setschedparam(&attr, &param);
+    SetAttrAffinity(&attr, cpus);
+    int ret = pthread_create(&g_exporter, &attr, &ExporterMain, NULL);
+    pthread_attr_destroy(&attr);
+    if (ret) {
+        close(fd);
+        g_listen_fd = -1;
+        throw std::runtime_error{std::string("metrics exporter pthread_create failed: ") + strerror(ret)};
+    }
+    printf("Metrics: Prometheus exporter on port %d (CPUs %s)\n", port, FormatCpuList(cpus).c_str());
+}
+
+void MetricsStopServing() {
+    if (g_listen_fd < 0) return;
+    g_exporter_stop.store(true, std::memory_order_release);
+    pthread_join(g_exporter, NULL);
+    close(g_listen_fd);
+    g_listen_fd = -1;
+}
+
+// Smallest bucket bound covering fraction q of the cycles, in us (-1 = beyond the last)
+static long BucketPercentileUs(const MetricsSlot& s, double q) {
+    uint64_t total = 0, counts[METRICS_BUCKETS];
+    for (int b = 0; b < METRICS_BUCKETS; b++) total += counts[b] = s.buckets[b].load(std::memory_order_relaxed);
+    uint64_t seen = 0;
+    for (int b = 0; b < METRICS_BUCKETS - 1; b++) {
+        seen += counts[b];
+        if (seen >= q * total) return kMetricsBucketUs[b];
+    }
+    return -1;
+}
+
+static void PrintPage(const MetricsPage& page, bool alive) {
+    static const char* kStates[] = {"idle", "running", "done"};
+    if (alive) {
+        printf("p3 pid %d, running %.1f s: %s\n", page.pid, (TimingNowNs() - page.start_ns) * 1e-9, page.description);
+    } else {
+        printf("p3 pid %d, ended: %s\n", page.pid, page.description);
+    }
+    printf("%5s %-6s %-14s %-7s %4s %9s %9s %9s %10s %10s %10s\n", "app", "class", "workload", "state", "cpu", "cycles",
+           "overruns", "frames", "lat avg us", "lat p99 us", "lat max us");
+    const auto relaxed = std::memory_order_relaxed;
+    for (uint32_t i = 0; i < SlotsUsed(page); i++) {
+        const MetricsSlot& s = page.slots[i];
+        uint32_t state = s.state.load(relaxed);
+        uint64_t cycles = s.cycles.load(relaxed);
+        printf("%5d %-6s %-14.14s %-7s %4d %9llu %9llu %9llu", s.app_id, s.cls, s.workload,
+               state <= METRICS_DONE ? kStates[state] : "?", s.cpu.load(relaxed), (unsigned long long)cycles,
+               (unsigned long long)s.overruns.load(relaxed), (unsigned long long)s.frames.load(relaxed));
+        if (cycles) {
+            long p99 = BucketPercentileUs(s, 0.99);
+            char p99_text[24];
+            if (p99 < 0) {
+                snprintf(p99_text, sizeof(p99_text), ">%ld", kMetricsBucketUs[METRICS_BUCKETS - 2]);
+            } else {
+                snprintf(p99_text, sizeof(p99_text), "<=%ld", p99);
+            }
+            printf(" %10.1f %10s %10.1f\n", s.latency_sum_ns.load(relaxed) / 1000.0 / cycles, p99_text,
+                   s.latency_max_ns.load(relaxed) / 1000.0);
+        } else {
+            printf(" %10s %10s %10s\n", "-", "-", "-");
+        }
+    }
+}
+
+int MetricsCli(const std::string& name, int interval_sec) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        printf("ERROR: %s: %s (is a run with metrics = %s active?)\n", name.c_str(), strerror(errno), name.c_str());
+        return 1;
+    }
+    void* map = mmap(NULL, sizeof(MetricsPage), PROT_READ, MAP_SHARED, fd, 0);
+    off_t size = lseek(fd, 0, SEEK_END);
+    close(fd);
+    if (map == MAP_FAILED || size < (off_t)sizeof(MetricsPage)) {
+        if (map != MAP_FAILED) munmap(map, sizeof(MetricsPage));
+        printf("ERROR: %s is not a p3 metrics page\n", name.c_str());
+        return 1;
+    }
+    const MetricsPage& page = *static_cast<const MetricsPage*>(map);
+    int status = 0;
+    if (page.magic != METRICS_MAGIC || page.version != METRICS_VERSION) {
+        printf("ERROR: %s is not a version %d p3 metrics page\n", name.c_str(), METRICS_VERSION);
+        status = 1;
+    } else {
+        for (;;) {
+            bool alive = kill(page.pid, 0) == 0 || errno == EPERM;
+            PrintPage(page, alive);
+            if (interval_sec <= 0 || !alive) break;
+            sleep(interval_sec);
+            printf("\n");
+        }
+    }
+    munmap(map, sizeof(MetricsPage));
+    return status;
+}
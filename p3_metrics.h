@@ -0,0 +1,129 @@
+/**
+ * Live run metrics in a shared-memory page.
+ *
+ * With `metrics = /p3` in [experiment] the run creates a POSIX shared
+ * memory object of that name holding one fixed slot per app thread: cycle
+ * and overrun counts, wakeup latency as a bucketed histogram, frames
+ * processed, the last CPU and whether the thread is running. Only the
+ * owning thread writes its slot, with relaxed atomic loads and stores
+ * (no read-modify-write, no lock, no syscall), so readers in this or any
+ * other process never slow the RT path down.
+ *
+ * Readers: `metrics_port = 9464` serves the page in Prometheus text format
+ * from a SCHED_OTHER exporter thread on the NRT cores, and
+ * `./p3 --stats [/p3 [seconds]]` prints it as a table, once or refreshed
+ * every few seconds until the run ends. The object is unlinked when the
+ * run finishes; a reader that still has it mapped sees the final values.
+ *
+ * Code on a thread with a slot calls MetricsFrame(); on any other thread
+ * it is a no-op.
+ */
+#ifndef P3_METRICS_H
+#define P3_METRICS_H
+
+#include <sched.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#define METRICS_SLOTS 64
+#define METRICS_BUCKETS 12  // wakeup latency; the last one is +Inf
+#define METRICS_MAGIC 0x70334d54u  // "p3MT"
+#define METRICS_VERSION 1
+
+// Upper bounds of the finite buckets, microseconds
+extern const long kMetricsBucketUs[METRICS_BUCKETS - 1];
+
+enum MetricsState : uint32_t { METRICS_IDLE, METRICS_RUNNING, METRICS_DONE };
+
+struct MetricsSlot {
+    // Set by MetricsClaim() before the thread starts
+    int32_t app_id;
+    char cls[8];  // rt | nrt | stress | stage
+    char workload[48];
+
+    // Owning thread only
+    std::atomic<uint32_t> state;
+    std::atomic<int32_t> cpu;
+    std::atomic<uint64_t> cycles;
+    std::atomic<uint64_t> overruns;
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> latency_sum_ns;
+    std::atomic<uint64_t> latency_max_ns;
+    std::atomic<uint64_t> buckets[METRICS_BUCKETS];  // per bucket, not cumulative
+
+    static void Bump(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // One periodic cycle: its wakeup latency and whether it overran
+    void RecordCycle(long latency_ns, bool overrun) {
+        uint64_t ns = latency_ns > 0 ? (uint64_t)latency_ns : 0;
+        int b = 0;
+        while (b < METRICS_BUCKETS - 1 && (long)(ns / 1000) >= kMetricsBucketUs[b]) b++;
+        Bump(buckets[b]);
+        Bump(latency_sum_ns, ns);
+        if (ns > latency_max_ns.load(std::memory_order_relaxed)) latency_max_ns.store(ns, std::memory_order_relaxed);
+        if (overrun) Bump(overruns);
+        Bump(cycles);
+        cpu.store(sched_getcpu(), std::memory_order_relaxed);
+    }
+};
+
+struct MetricsPage {
+    uint32_t magic;  // METRICS_MAGIC once the page is initialised
+    uint32_t version;
+    int32_t pid;  // of the run
+    std::atomic<uint32_t> slots_used;
+    uint64_t start_ns;  // TimingNowNs() when the run began
+    char description[128];
+    MetricsSlot slots[METRICS_SLOTS];
+};
+
+// Create and map the shared-memory object `name` (such as /p3) for this
+// run; call before LockMemory(). Throws std::runtime_error.
+void MetricsOpen(const std::string& name, const std::string& description);
+
+// Unmap and unlink the page; slots handed out become invalid
+void MetricsClose();
+
+bool MetricsEnabled();
+
+// A zeroed slot for one thread, or NULL if metrics are off or the page is
+// full (printed once). Main thread, before the thread starts.
+MetricsSlot* MetricsClaim(int app_id, const char* cls, const std::string& workload);
+
+// The calling thread's slot (NULL to detach); set by the thread classes
+extern thread_local MetricsSlot* g_metrics_self;
+
+inline void MetricsFrame(uint64_t n = 1) {
+    if (g_metrics_self) MetricsSlot::Bump(g_metrics_self->frames, n);
+}
+
+// Thread entry and exit, on the thread itself
+inline void MetricsBegin(MetricsSlot* slot) {
+    g_metrics_self = slot;
+    if (!slot) return;
+    slot->cpu.store(sched_getcpu(), std::memory_order_relaxed);
+    slot->state.store(METRICS_RUNNING, std::memory_order_relaxed);
+}
+inline void MetricsEnd() {
+    if (g_metrics_self) g_metrics_self->state.store(METRICS_DONE, std::memory_order_relaxed);
+    g_metrics_self = NULL;
+}
+
+// Serve the page as Prometheus text on `port` (any path) from an NRT
+// thread restricted to `cpus`. Throws std::runtime_error if the socket or
+// thread cannot be set up.
+void MetricsServe(int port, const cpu_set_t& cpus);
+void MetricsStopServing();
+
+// The page in Prometheus text exposition format
+std::string MetricsPrometheus(const MetricsPage& page);
+
+// ./p3 --stats: print the page `name` once (interval_sec == 0) or every
+// interval_sec until its run exits; returns the process exit status
+int MetricsCli(const std::string& name, int interval_sec);
+
+#endif
@@ -0,0 +1,52 @@
+#include "p3_overrun.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* kPolicyNames[] = {"log", "skip", "degrade"};
+
+bool OverrunPolicyFromName(const char* name, OverrunPolicy* policy) {
+    for (int i = 0; i <= OVERRUN_DEGRADE; i++) {
+        if (strcmp(name, kPolicyNames[i]) == 0) {
+            *policy = (OverrunPolicy)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* OverrunPolicyName(OverrunPolicy policy) { return kPolicyNames[policy]; }
+
+void DeadlineMonitor::Met(bool degraded) {
+    streak_ = 0;
+    on_time_++;
+    if (degraded) degraded_cycles_++;
+}
+
+void DeadlineMonitor::Missed(int cycle, long late_ns, bool degraded) {
+    misses_++;
+    on_time_ = 0;
+    if (streak_++ == 0) streaks_++;
+    if (streak_ > longest_streak_) longest_streak_ = streak_;
+    if (late_ns > max_late_ns_) max_late_ns_ = late_ns;
+    if (degraded) degraded_cycles_++;
+    log_[logged_++ % MISS_LOG_ENTRIES] = {cycle, late_ns};
+}
+
+void DeadlineMonitor::Print(int app_id, OverrunPolicy policy) const {
+    if (misses_ == 0) return;
+    printf("App #%d deadline misses (%s): %ld, streaks %ld (longest %ld, mean %.1f), worst %.1f us late", app_id,
+           OverrunPolicyName(policy), misses_, streaks_, longest_streak_, (double)misses_ / streaks_,
+           max_late_ns_ / 1000.0);
+    if (skipped_) printf(", %ld releases skipped", skipped_);
+    if (degraded_cycles_) printf(", %ld cycles degraded", degraded_cycles_);
+    printf("\n");
+
+    // Oldest first
+    uint64_t n = logged_ < MISS_LOG_ENTRIES ? logged_ : MISS_LOG_ENTRIES;
+    printf("App #%d last misses:", app_id);
+    for (uint64_t i = logged_ - n; i < logged_; i++) {
+        const Miss& m = log_[i % MISS_LOG_ENTRIES];
+        printf(" cycle %d +%.1f us%s", m.cycle, m.late_ns / 1000.0, i + 1 < logged_ ? "," : "\n");
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * Deadline-miss tracking and overload policies for periodic RT apps.
+ *
+ * When a cycle finishes after its deadline the periodic loop applies one
+ * of three policies, chosen per app (`overrun = ...`):
+ *
+ *   log     - record the miss and carry on; releases stay on the absolute
+ *             timeline, so a long cycle is followed by back-to-back catch-up
+ *             cycles
+ *   skip    - drop the next release and every release that has already
+ *             passed, so the next cycle starts on a future release and the
+ *             output rate never exceeds one frame per period
+ *   degrade - switch the workload to a cheaper mode (Workload::SetDegraded(),
+ *             e.g. a smaller Gaussian for CannyP3) until it has met
+ *             DEGRADE_RECOVER_CYCLES deadlines in a row
+ *
+ * DeadlineMonitor keeps the bookkeeping the thread reports at Join(): miss
+ * count, miss streaks (runs of consecutive misses) and the last few misses.
+ * All of it is fixed-size, so recording on the RT hot path never allocates.
+ */
+#ifndef P3_OVERRUN_H
+#define P3_OVERRUN_H
+
+#include <stdint.h>
+
+enum OverrunPolicy { OVERRUN_LOG, OVERRUN_SKIP, OVERRUN_DEGRADE };
+
+// "log" / "skip" / "degrade"; false if unknown
+bool OverrunPolicyFromName(const char* name, OverrunPolicy* policy);
+const char* OverrunPolicyName(OverrunPolicy policy);
+
+#define DEGRADE_RECOVER_CYCLES 30  // on-time cycles before full quality returns
+#define MISS_LOG_ENTRIES 8         // most recent misses kept for the report
+
+class DeadlineMonitor {
+   public:
+    void Met(bool degraded);
+    void Missed(int cycle, long late_ns, bool degraded);
+    void Skipped(long releases) { skipped_ += releases; }
+
+    long misses() const { return misses_; }
+    long streak() const { return streak_; }  // current run of misses
+    long on_time() const { return on_time_; }  // current run of met deadlines
+
+    // "App #N deadline misses: .., streaks .. (longest .., mean ..), ..."
+    // plus the most recent misses; prints nothing if none were missed
+    void Print(int app_id, OverrunPolicy policy) const;
+
+   private:
+    long misses_ = 0;
+    long streak_ = 0;
+    long on_time_ = 0;
+    long streaks_ = 0;
+    long longest_streak_ = 0;
+    long max_late_ns_ = 0;
+    long skipped_ = 0;
+    long degraded_cycles_ = 0;
+
+    struct Miss {
+        int cycle;
+        long late_ns;
+    };
+    Miss log_[MISS_LOG_ENTRIES];
+    uint64_t logged_ = 0;
+};
+
+#endif
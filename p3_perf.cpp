@@ -0,0 +1,130 @@
+#include "p3_perf.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    const char* name;
+} kEvents[NUM_PERF_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache-misses"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "ctx-switches"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, "migrations"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "page-faults"},
+};
+
+// Counter value plus enabled/running times, to scale multiplexed events
+struct PerfReading {
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+};
+
+static int OpenEvent(uint32_t type, uint64_t config, bool exclude_kernel) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = 1;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    attr.inherit = 0;  // canny band helpers and writers are not this thread
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+PerfCounters::PerfCounters() {
+    for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+        fds_[i] = -1;
+        valid_[i] = false;
+        values_[i] = 0;
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+        if (fds_[i] >= 0) close(fds_[i]);
+    }
+}
+
+void PerfCounters::Start() {
+    for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+        // User+kernel if allowed, else user only (perf_event_paranoid >= 2)
+        int fd = OpenEvent(kEvents[i].type, kEvents[i].config, false);
+        if (fd < 0 && (errno == EACCES || errno == EPERM)) fd = OpenEvent(kEvents[i].type, kEvents[i].config, true);
+        fds_[i] = fd;
+    }
+
+    struct rusage ru;
+    rusage_ok_ = getrusage(RUSAGE_THREAD, &ru) == 0;
+    if (rusage_ok_) {
+        nvcsw_ = ru.ru_nvcsw;
+        nivcsw_ = ru.ru_nivcsw;
+        minflt_ = ru.ru_minflt;
+        majflt_ = ru.ru_majflt;
+    }
+    for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+        if (fds_[i] >= 0) ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void PerfCounters::Stop() {
+    for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+        if (fds_[i] >= 0) ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    struct rusage ru;
+    if (rusage_ok_ && getrusage(RUSAGE_THREAD, &ru) == 0) {
+        nvcsw_ = ru.ru_nvcsw - nvcsw_;
+        nivcsw_ = ru.ru_nivcsw - nivcsw_;
+        minflt_ = ru.ru_minflt - minflt_;
+        majflt_ = ru.ru_majflt - majflt_;
+    } else {
+        rusage_ok_ = false;
+    }
+
+    for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+        if (fds_[i] < 0) continue;
+        PerfReading r;
+        if (read(fds_[i], &r, sizeof(r)) == (ssize_t)sizeof(r) && r.time_running > 0) {
+            values_[i] = r.value;
+            // More events than PMU counters: the kernel time-shares them
+            if (r.time_running < r.time_enabled) {
+                values_[i] = (uint64_t)((double)r.value * r.time_enabled / r.time_running);
+            }
+            valid_[i] = true;
+        }
+        close(fds_[i]);
+        fds_[i] = -1;
+    }
+}
+
+void PerfCounters::Print(int app_id) const {
+    printf("App #%d counters:", app_id);
+    for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+        if (valid_[i]) {
+            printf(" %s %llu", kEvents[i].name, (unsigned long long)values_[i]);
+        } else {
+            printf(" %s n/a", kEvents[i].name);
+        }
+        if (i == PERF_INSTRUCTIONS && valid_[PERF_CYCLES] && valid_[PERF_INSTRUCTIONS] && values_[PERF_CYCLES]) {
+            printf(" (IPC %.2f)", (double)values_[PERF_INSTRUCTIONS] / values_[PERF_CYCLES]);
+        }
+        if (i == PERF_CONTEXT_SWITCHES && rusage_ok_) {
+            printf(" (voluntary %ld, involuntary %ld)", nvcsw_, nivcsw_);
+        }
+        if (i == PERF_PAGE_FAULTS && rusage_ok_) {
+            printf(" (minor %ld, major %ld)", minflt_, majflt_);
+        }
+        printf(i + 1 < NUM_PERF_EVENTS ? "," : "\n");
+    }
+}
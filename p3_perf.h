@@ -0,0 +1,58 @@
+/**
+ * Per-thread hardware and software counters.
+ *
+ * Start() runs on the measured thread itself and opens one
+ * perf_event_open() counter per event, bound to that thread only
+ * (pid 0, any CPU, not inherited by threads it creates); Stop() reads the
+ * deltas. Voluntary and involuntary context switches come from
+ * getrusage(RUSAGE_THREAD). Events the kernel or PMU refuses (e.g.
+ * perf_event_paranoid, no PMU in a VM) are reported as n/a; the run itself
+ * never fails because of them.
+ */
+#ifndef P3_PERF_H
+#define P3_PERF_H
+
+#include <stdint.h>
+
+enum PerfEvent {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_CONTEXT_SWITCHES,
+    PERF_MIGRATIONS,
+    PERF_PAGE_FAULTS,
+    NUM_PERF_EVENTS
+};
+
+class PerfCounters {
+   public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    void Start();  // on the measured thread
+    void Stop();   // on the measured thread; closes the counters
+
+    bool valid(PerfEvent event) const { return valid_[event]; }
+    uint64_t value(PerfEvent event) const { return values_[event]; }
+
+    // Page faults the thread took between Start and Stop (from getrusage;
+    // -1 if unavailable). An RT measured section should report none.
+    long minor_faults() const { return rusage_ok_ ? minflt_ : -1; }
+    long major_faults() const { return rusage_ok_ ? majflt_ : -1; }
+
+    // "App #N counters: cycles .., instructions .. (IPC ..), ..."
+    void Print(int app_id) const;
+
+   private:
+    int fds_[NUM_PERF_EVENTS];
+    bool valid_[NUM_PERF_EVENTS];
+    uint64_t values_[NUM_PERF_EVENTS];
+    long nvcsw_ = 0, nivcsw_ = 0;  // voluntary / involuntary switches
+    long minflt_ = 0, majflt_ = 0;
+    bool rusage_ok_ = false;
+};
+
+#endif
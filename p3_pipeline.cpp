@@ -0,0 +1,259 @@
+#include "p3_pipeline.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Stage threads: plain ThreadRT/ThreadNRT whose workload is one stage loop
+class StageRT : public ThreadRT {
+   public:
+    StageRT(CannyPipeline* pipeline, int stage, int app_id, int priority, int policy)
+        : ThreadRT(app_id, priority, policy), pipeline_(pipeline), stage_(stage) {}
+    void Run() { pipeline_->RunStage(stage_); }
+
+   private:
+    CannyPipeline* pipeline_;
+    int stage_;
+};
+
+class StageNRT : public ThreadNRT {
+   public:
+    StageNRT(CannyPipeline* pipeline, int stage, int app_id) : ThreadNRT(app_id), pipeline_(pipeline), stage_(stage) {}
+    void Run() { pipeline_->RunStage(stage_); }
+
+   private:
+    CannyPipeline* pipeline_;
+    int stage_;
+};
+
+CannyPipeline::CannyPipeline(const std::vector<ThreadSpec>& stages, int first_app_id) : first_app_id_(first_app_id) {
+    for (const ThreadSpec& t : stages) {
+        specs_[PipelineStageFromName(t.name)] = t;
+    }
+    for (int s = 0; s < NUM_STAGES; s++) {
+        const ThreadSpec& t = specs_[s];
+        int app_id = first_app_id + s;
+        if (t.cls == THREAD_RT) {
+            rt_[s].reset(new StageRT(this, s, app_id, t.priority, t.policy));
+            if (t.pinned) rt_[s]->SetAffinity(t.cpus);
+            if (t.policy == SCHED_DEADLINE) rt_[s]->SetDeadline(t.runtime_us, t.deadline_us, t.period_us);
+        } else {
+            nrt_[s].reset(new StageNRT(this, s, app_id));
+            if (t.pinned) nrt_[s]->SetAffinity(t.cpus);
+        }
+    }
+}
+
+CannyPipeline::~CannyPipeline() {}
+
+bool CannyPipeline::Open() {
+    // input_raw on the capture stage replaces decoding with mapped frames
+    const std::string& raw = specs_[STAGE_CAPTURE].input_raw;
+    if (!raw.empty()) {
+        try {
+            raw_.reset(new RawFrameSource(raw));
+        } catch (const std::exception& e) {
+            cout << e.what() << endl;
+            return false;
+        }
+        rows_ = raw_->rows();
+        cols_ = raw_->cols();
+    } else if (!cap_.open("ground_crew_480p.mp4")) {
+        cout << "Failed to open /dev/video0" << endl;
+        return false;
+    }
+    if (!raw_) {
+        cap_.set(CAP_PROP_FRAME_WIDTH, WIDTH);
+        cap_.set(CAP_PROP_FRAME_HEIGHT, HEIGHT);
+        // test capture; the decoder may not honor the requested size
+        cap_ >> bgr_[0];
+        if (bgr_[0].empty()) {
+            cout << "ground_crew_480p.mp4 has no frames" << endl;
+            return false;
+        }
+        rows_ = bgr_[0].rows;
+        cols_ = bgr_[0].cols;
+    }
+
+    // Preallocate every slot before the stages start, at the size actually
+    // opened; cap >> and cvtColor reuse a Mat's buffer when size and type
+    // already match, so gray frames stay in the locked pool
+    gray_pool_.reset(new FramePool(PIPELINE_SLOTS, rows_, cols_));
+    for (int i = 0; i < PIPELINE_SLOTS; i++) {
+        if (!raw_) cap_ >> bgr_[i];
+        gray_[i] = Mat(rows_, cols_, CV_8UC1, gray_pool_->frame(i));
+        free_bgr_.Push(i);
+        free_gray_.Push(i);
+    }
+
+    // edge_output on the write stage picks the sink, as for CannyStream;
+    // the write stage thread is the writer, so edge_cpus does not apply
+    char prefix[128];
+    sprintf(prefix, "camera_s_%3.2f_l_%3.2f_h_%3.2f", sigma_, tlow_, thigh_);
+    try {
+        writer_.reset(new EdgeWriter(specs_[STAGE_WRITE].edge_output, rows_, cols_, prefix, false));
+    } catch (const std::exception& e) {
+        cout << e.what() << endl;
+        return false;
+    }
+    if (!raw_) {
+        cap_.set(CAP_PROP_POS_FRAMES, 0);
+        cap_ >> bgr_[0];
+    }
+
+    // The canny stage's kernel, picked once for the size actually opened
+    bool fixed;
+    canny_ = CannySelect(specs_[STAGE_CANNY].canny_mode, rows_, cols_, &fixed);
+    printf("Pipeline: %dx%d input, %s %s kernels\n", cols_, rows_, fixed ? "fixed-size" : "generic",
+           CannyModeName(specs_[STAGE_CANNY].canny_mode));
+    return true;
+}
+
+void CannyPipeline::EnableTrace() {
+    for (int s = 0; s < NUM_STAGES; s++) {
+        std::string name = "App #" + std::to_string(first_app_id_ + s) + " stage " + PipelineStageName(s);
+        if (rt_[s]) {
+            rt_[s]->EnableTrace(name);
+        } else {
+            nrt_[s]->EnableTrace(name);
+        }
+    }
+}
+
+void CannyPipeline::EnableMetrics() {
+    for (int s = 0; s < NUM_STAGES; s++) {
+        std::string name = std::string("stage ") + PipelineStageName(s);
+        if (rt_[s]) {
+            rt_[s]->EnableMetrics("stage", name);
+        } else {
+            nrt_[s]->EnableMetrics("stage", name);
+        }
+    }
+}
+
+void CannyPipeline::Start() {
+    for (int s = 0; s < NUM_STAGES; s++) {
+        printf("Pipeline stage %s: App #%d (%s)\n", PipelineStageName(s), first_app_id_ + s,
+               specs_[s].cls == THREAD_RT ? "RT" : "NRT");
+    }
+    wall_.Start();
+    // Start from the sink so every consumer is waiting before data arrives
+    for (int s = NUM_STAGES - 1; s >= 0; s--) {
+        if (rt_[s]) {
+            rt_[s]->Start();
+        } else {
+            nrt_[s]->Start();
+        }
+    }
+}
+
+void CannyPipeline::Join() {
+    for (int s = 0; s < NUM_STAGES; s++) {
+        if (rt_[s]) {
+            rt_[s]->Join();
+        } else {
+            nrt_[s]->Join();
+        }
+    }
+    printf("Pipeline: %d frames in %.6f seconds (%.2f frames/sec)\n", frames_written_, wall_.elapsed_sec(),
+           frames_written_ / wall_.elapsed_sec());
+}
+
+void CannyPipeline::RunStage(int stage) {
+    switch (stage) {
+        case STAGE_CAPTURE:
+            Capture();
+            break;
+        case STAGE_GRAY:
+            Gray();
+            break;
+        case STAGE_CANNY:
+            Canny();
+            break;
+        case STAGE_WRITE:
+            Write();
+            break;
+    }
+}
+
+void CannyPipeline::Capture() {
+    for (int seq = 0; seq < MAX_FRAME_NUM; seq++) {
+        PipelineItem item = {0, seq};
+        free_bgr_.PopWait(&item.slot);
+        if (raw_) {
+            captured_.PushWait(item);  // Gray() reads the mapped frame
+            continue;
+        }
+        cap_ >> bgr_[item.slot];
+        if (bgr_[item.slot].empty()) {
+            cap_.set(CAP_PROP_POS_FRAMES, 0);
+            cap_ >> bgr_[item.slot];
+        }  // end of video stream, repeat
+        captured_.PushWait(item);
+    }
+    PipelineItem end = {-1, MAX_FRAME_NUM};
+    captured_.PushWait(end);
+}
+
+void CannyPipeline::Gray() {
+    for (;;) {
+        PipelineItem item;
+        captured_.PopWait(&item);
+        if (item.slot < 0) {
+            grayed_.PushWait(item);
+            return;
+        }
+        int gray;
+        free_gray_.PopWait(&gray);
+        if (raw_) {
+            memcpy(gray_pool_->frame(gray), raw_->frame(item.seq), (size_t)rows_ * cols_);
+        } else {
+            cvtColor(bgr_[item.slot], gray_[gray], COLOR_BGR2GRAY);
+        }
+        free_bgr_.PushWait(item.slot);
+        item.slot = gray;
+        grayed_.PushWait(item);
+    }
+}
+
+void CannyPipeline::Canny() {
+    // Created on the stage thread so band helpers inherit its scheduling;
+    // nothing catches there, so a team that cannot start means whole frames
+    std::unique_ptr<CannyTiled> tiled;
+    try {
+        tiled.reset(CannyTiled::ForCaller(specs_[STAGE_CANNY].canny_tiling, rows_, cols_));
+    } catch (const std::exception& e) {
+        printf("Pipeline canny stage: %s, running untiled\n", e.what());
+    }
+    for (;;) {
+        PipelineItem item;
+        grayed_.PopWait(&item);
+        if (item.slot < 0) {
+            writer_->End();
+            return;
+        }
+        // Downstream of this stage may block, so wait for a writer slot
+        // instead of dropping the frame
+        int edge, spins = 0;
+        while ((edge = writer_->Acquire()) < 0) RingBackoff(&spins);
+        Trace(TRACE_FRAME_BEGIN, item.seq);
+        if (tiled) {
+            tiled->Run(gray_[item.slot].data, sigma_, tlow_, thigh_, writer_->frame(edge), gray_pool_->scratch());
+        } else {
+            canny_(gray_[item.slot].data, rows_, cols_, sigma_, tlow_, thigh_, writer_->frame(edge),
+                   gray_pool_->scratch());
+        }
+        Trace(TRACE_FRAME_END, item.seq);
+        MetricsFrame();
+        free_gray_.PushWait(item.slot);
+        writer_->Submit(edge, item.seq);
+        frames_written_++;
+    }
+}
+
+void CannyPipeline::Write() {
+    // Runs until the canny stage ends the stream; the file I/O happens
+    // here, on this stage's CPUs and class
+    writer_->Serve();
+    writer_->Close();
+    wall_.Stop();
+}
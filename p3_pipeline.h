@@ -0,0 +1,79 @@
+/**
+ * Staged CannyP3: capture -> grayscale -> canny -> write, one thread per
+ * stage, connected by bounded SPSC rings.
+ *
+ * Frame buffers are a fixed set of slots recycled through "free" rings, so
+ * a slow stage applies back-pressure instead of growing a queue; gray
+ * slots come from a page-locked FramePool. The canny stage computes straight
+ * into the EdgeWriter's slots and the write stage runs that writer's loop
+ * itself, so edges are neither copied nor handed to another thread. Each stage
+ * has its own RT/NRT class, policy, priority and CPU mask, taken from the
+ * experiment's [stage] sections.
+ */
+#ifndef P3_PIPELINE_H
+#define P3_PIPELINE_H
+
+#include <memory>
+#include <vector>
+
+#include "p3_edgewriter.h"
+#include "p3_experiment.h"
+#include "p3_ring.h"
+#include "p3_thread.h"
+#include "p3_util.h"
+
+#define PIPELINE_SLOTS 4  // frames in flight per buffer kind (power of two)
+
+// Token passed between stages; slot < 0 marks the end of the stream
+struct PipelineItem {
+    int slot;  // BGR or gray slot, depending on the ring
+    int seq;
+};
+
+class CannyPipeline {
+   public:
+    // stages: [stage] specs by name (missing stages run as NRT on any CPU);
+    // stage threads are numbered from first_app_id
+    CannyPipeline(const std::vector<ThreadSpec>& stages, int first_app_id);
+    ~CannyPipeline();
+
+    bool Open();
+    void Start();
+    void Join();  // joins every stage and reports frames/sec
+    void EnableTrace();  // one trace row per stage; before Start()
+    void EnableMetrics();  // one metrics slot per stage; before Start()
+
+    void RunStage(int stage);
+
+   private:
+    void Capture();
+    void Gray();
+    void Canny();
+    void Write();
+
+    VideoCapture cap_;
+    std::unique_ptr<RawFrameSource> raw_;  // input_raw on the capture stage
+    Mat bgr_[PIPELINE_SLOTS];
+    Mat gray_[PIPELINE_SLOTS];  // wrap gray_pool_ frames
+    float sigma_ = 1, tlow_ = 0.2, thigh_ = 0.6;
+    int rows_ = HEIGHT, cols_ = WIDTH;  // of the input actually opened
+    CannyFn canny_ = NULL;              // CannySelect() for rows_ x cols_
+
+    // Gray frames plus the canny stage's scratch, locked up front
+    std::unique_ptr<FramePool> gray_pool_;
+    // Filled by the canny stage, served by the write stage (no own thread)
+    std::unique_ptr<EdgeWriter> writer_;
+
+    SpscRing<int, PIPELINE_SLOTS> free_bgr_, free_gray_;
+    SpscRing<PipelineItem, PIPELINE_SLOTS> captured_, grayed_;
+
+    int first_app_id_;
+    ThreadSpec specs_[NUM_STAGES];
+    std::unique_ptr<ThreadRT> rt_[NUM_STAGES];
+    std::unique_ptr<ThreadNRT> nrt_[NUM_STAGES];
+
+    Stopwatch wall_;
+    int frames_written_ = 0;
+};
+
+#endif
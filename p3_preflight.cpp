@@ -0,0 +1,231 @@
+#include "p3_preflight.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "p3_experiment.h"
+#include "p3_sched.h"
+
+static const char* kModeNames[] = {"off", "warn", "enforce"};
+
+static const char* kChecks[] = {"preempt_rt", "rt_throttling", "governor",      "isolcpus",
+                                "nohz_full",  "irq_affinity",  "rlimit_rtprio", "rlimit_memlock"};
+
+bool PreflightModeFromName(const std::string& name, PreflightMode* mode) {
+    for (int i = 0; i <= PREFLIGHT_ENFORCE; i++) {
+        if (name == kModeNames[i]) {
+            *mode = (PreflightMode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* PreflightModeName(PreflightMode mode) { return kModeNames[mode]; }
+
+bool IsPreflightCheck(const std::string& name) {
+    for (const char* check : kChecks) {
+        if (name == check) return true;
+    }
+    return false;
+}
+
+enum CheckStatus { CHECK_OK, CHECK_BAD, CHECK_SKIPPED };
+
+struct CheckResult {
+    CheckStatus status;
+    std::string detail;
+};
+
+// First line of a /proc or /sys file; false if it cannot be read
+static bool ReadLine(const std::string& path, std::string* line) {
+    std::ifstream file(path);
+    if (!std::getline(file, *line)) return false;
+    while (!line->empty() && (line->back() == '\n' || line->back() == ' ')) line->pop_back();
+    return true;
+}
+
+// CPUs of `want` missing from the list in `path` (empty or "(null)" = none)
+static std::string MissingCpus(const std::string& path, const cpu_set_t& want) {
+    std::string text;
+    cpu_set_t have;
+    CPU_ZERO(&have);
+    if (ReadLine(path, &text) && !text.empty() && text != "(null)" && !ParseCpuList(text, &have)) CPU_ZERO(&have);
+    cpu_set_t missing;
+    CPU_ZERO(&missing);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &want) && !CPU_ISSET(cpu, &have)) CPU_SET(cpu, &missing);
+    }
+    return CPU_COUNT(&missing) ? FormatCpuList(missing) : "";
+}
+
+static CheckResult CheckPreemptRt() {
+    struct utsname u;
+    std::string realtime;
+    bool rt = (uname(&u) == 0 && strstr(u.version, "PREEMPT_RT")) ||
+              (ReadLine("/sys/kernel/realtime", &realtime) && realtime == "1");
+    std::string release = uname(&u) == 0 ? u.release : "unknown";
+    if (rt) return {CHECK_OK, "PREEMPT_RT kernel " + release};
+    return {CHECK_BAD, "kernel " + release + " is not PREEMPT_RT: RT wakeups wait behind non-preemptible kernel code"};
+}
+
+static CheckResult CheckRtThrottling() {
+    std::string runtime, period;
+    if (!ReadLine("/proc/sys/kernel/sched_rt_runtime_us", &runtime)) {
+        return {CHECK_SKIPPED, "no /proc/sys/kernel/sched_rt_runtime_us"};
+    }
+    if (runtime == "-1") return {CHECK_OK, "RT bandwidth unlimited"};
+    if (!ReadLine("/proc/sys/kernel/sched_rt_period_us", &period)) period = "?";
+    return {CHECK_BAD, "RT tasks get " + runtime + " of every " + period +
+                           " us, then are throttled (echo -1 > /proc/sys/kernel/sched_rt_runtime_us)"};
+}
+
+static CheckResult CheckGovernor(const cpu_set_t& rt) {
+    if (CPU_COUNT(&rt) == 0) return {CHECK_SKIPPED, "no pinned RT cores"};
+    std::string detail;
+    cpu_set_t slow;
+    CPU_ZERO(&slow);
+    int read = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &rt)) continue;
+        std::string governor;
+        if (!ReadLine("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/scaling_governor", &governor)) {
+            continue;
+        }
+        read++;
+        if (governor != "performance") {
+            CPU_SET(cpu, &slow);
+            if (detail.empty()) detail = governor;
+        }
+    }
+    if (read == 0) return {CHECK_SKIPPED, "no cpufreq for the RT cores"};
+    if (CPU_COUNT(&slow) == 0) return {CHECK_OK, "performance on CPUs " + FormatCpuList(rt)};
+    return {CHECK_BAD, "CPUs " + FormatCpuList(slow) + " use '" + detail +
+                           "': frame times follow the clock (cpupower frequency-set -g performance)"};
+}
+
+static CheckResult CheckCpuList(const cpu_set_t& rt, const char* path, const char* param) {
+    if (CPU_COUNT(&rt) == 0) return {CHECK_SKIPPED, "no pinned RT cores"};
+    std::string missing = MissingCpus(path, rt);
+    if (missing.empty()) return {CHECK_OK, "CPUs " + FormatCpuList(rt)};
+    return {CHECK_BAD, std::string("RT CPUs ") + missing + " not in " + param + "= (kernel command line)"};
+}
+
+// Device IRQs whose affinity includes an RT core. IRQs without a handler
+// (no action subdirectory) are not counted.
+static CheckResult CheckIrqAffinity(const cpu_set_t& rt) {
+    if (CPU_COUNT(&rt) == 0) return {CHECK_SKIPPED, "no pinned RT cores"};
+    DIR* dir = opendir("/proc/irq");
+    if (!dir) return {CHECK_SKIPPED, "no /proc/irq"};
+    std::vector<int> hits;
+    int checked = 0;
+    while (struct dirent* entry = readdir(dir)) {
+        char* end;
+        long irq = strtol(entry->d_name, &end, 10);
+        if (*end != '\0' || end == entry->d_name) continue;
+        std::string base = std::string("/proc/irq/") + entry->d_name;
+
+        bool active = false;
+        if (DIR* sub = opendir(base.c_str())) {
+            while (struct dirent* e = readdir(sub)) {
+                if (e->d_type == DT_DIR && e->d_name[0] != '.') active = true;
+            }
+            closedir(sub);
+        }
+        if (!active) continue;
+
+        std::string list;
+        if (!ReadLine(base + "/effective_affinity_list", &list) && !ReadLine(base + "/smp_affinity_list", &list)) {
+            continue;
+        }
+        cpu_set_t cpus;
+        if (!ParseCpuList(list, &cpus)) continue;
+        checked++;
+        CPU_AND(&cpus, &cpus, &rt);
+        if (CPU_COUNT(&cpus)) hits.push_back((int)irq);
+    }
+    closedir(dir);
+    if (checked == 0) return {CHECK_SKIPPED, "no readable IRQ affinities"};
+    if (hits.empty()) return {CHECK_OK, std::to_string(checked) + " IRQs, none on CPUs " + FormatCpuList(rt)};
+
+    std::sort(hits.begin(), hits.end());
+    std::string irqs;
+    for (size_t i = 0; i < hits.size() && i < 8; i++) irqs += (i ? "," : "") + std::to_string(hits[i]);
+    if (hits.size() > 8) irqs += ",...";
+    return {CHECK_BAD, std::to_string(hits.size()) + " of " + std::to_string(checked) + " IRQs (" + irqs +
+                           ") may fire on RT CPUs (set /proc/irq/N/smp_affinity_list, or irqaffinity=)"};
+}
+
+static CheckResult CheckRtprio(const ExperimentSpec& spec) {
+    int highest = 0;
+    bool deadline = false;
+    auto scan = [&](const ThreadSpec& t) {
+        if (t.cls != THREAD_RT) return;
+        if (t.policy == SCHED_DEADLINE) {
+            deadline = true;
+        } else {
+            highest = std::max(highest, t.priority);
+        }
+        if (t.workload == "shared-lock" && t.lock_protocol == MUTEX_PROTECT) highest = std::max(highest, t.lock_ceiling);
+    };
+    for (const ThreadSpec& t : spec.threads) scan(t);
+    for (const ThreadSpec& t : spec.stages) scan(t);
+    if (highest == 0 && !deadline) return {CHECK_SKIPPED, "no RT threads"};
+    if (geteuid() == 0) return {CHECK_OK, "root"};
+    if (deadline) return {CHECK_BAD, "SCHED_DEADLINE needs root (CAP_SYS_NICE)"};
+
+    struct rlimit lim;
+    getrlimit(RLIMIT_RTPRIO, &lim);
+    if (lim.rlim_cur == RLIM_INFINITY || (long)lim.rlim_cur >= highest) {
+        return {CHECK_OK, "limit " + std::to_string((long)lim.rlim_cur) + " >= priority " + std::to_string(highest)};
+    }
+    return {CHECK_BAD, "limit " + std::to_string((long)lim.rlim_cur) + " < priority " + std::to_string(highest) +
+                           " (ulimit -r, or rtprio in /etc/security/limits.conf)"};
+}
+
+static CheckResult CheckMemlock() {
+    if (geteuid() == 0) return {CHECK_OK, "root"};
+    struct rlimit lim;
+    getrlimit(RLIMIT_MEMLOCK, &lim);
+    if (lim.rlim_cur == RLIM_INFINITY) return {CHECK_OK, "unlimited"};
+    // mlockall(MCL_FUTURE) must cover every mapping the run will ever make
+    return {CHECK_BAD, std::to_string((long)(lim.rlim_cur >> 10)) +
+                           " KB: mlockall() of the whole process will fail (ulimit -l unlimited)"};
+}
+
+int RunPreflight(const ExperimentSpec& spec) {
+    cpu_set_t rt = RtCpus(spec);
+    std::vector<CheckResult> results;
+    results.push_back(CheckPreemptRt());
+    results.push_back(CheckRtThrottling());
+    results.push_back(CheckGovernor(rt));
+    results.push_back(CheckCpuList(rt, "/sys/devices/system/cpu/isolated", "isolcpus"));
+    results.push_back(CheckCpuList(rt, "/sys/devices/system/cpu/nohz_full", "nohz_full"));
+    results.push_back(CheckIrqAffinity(rt));
+    results.push_back(CheckRtprio(spec));
+    results.push_back(CheckMemlock());
+
+    int count[3] = {0, 0, 0};
+    for (size_t i = 0; i < results.size(); i++) {
+        if (std::find(spec.preflight_skip.begin(), spec.preflight_skip.end(), kChecks[i]) != spec.preflight_skip.end()) {
+            results[i] = {CHECK_SKIPPED, "preflight_skip"};
+        }
+        count[results[i].status]++;
+    }
+
+    printf("Preflight (%s): %d ok, %d BAD, %d skipped\n", PreflightModeName(spec.preflight), count[CHECK_OK],
+           count[CHECK_BAD], count[CHECK_SKIPPED]);
+    static const char* kStatus[] = {"ok", "BAD", "skip"};
+    for (size_t i = 0; i < results.size(); i++) {
+        printf("  [%-4s] %-15s %s\n", kStatus[results[i].status], kChecks[i], results[i].detail.c_str());
+    }
+    return count[CHECK_BAD];
+}
@@ -0,0 +1,45 @@
+/**
+ * Startup checks of the system's RT preconditions.
+ *
+ * A misconfigured host still runs every experiment, it just produces bad
+ * latency numbers. Each check reads the kernel's own view (uname, /proc,
+ * /sys, getrlimit) for the experiment's RT cores (RtCpus()):
+ *
+ *   preempt_rt     - the kernel is PREEMPT_RT
+ *   rt_throttling  - sched_rt_runtime_us is -1 (no RT bandwidth limit)
+ *   governor       - the RT cores' cpufreq governor is performance
+ *   isolcpus       - the RT cores are isolated (isolcpus=)
+ *   nohz_full      - the RT cores run tickless (nohz_full=)
+ *   irq_affinity   - no device IRQ may be delivered to an RT core
+ *   rlimit_rtprio  - RLIMIT_RTPRIO covers the highest RT priority used
+ *                    (SCHED_DEADLINE needs root / CAP_SYS_NICE)
+ *   rlimit_memlock - mlockall() of the whole process is allowed
+ *
+ * A check is ok, BAD, or skipped when it does not apply (no pinned RT
+ * cores, no cpufreq). [experiment] preflight = warn prints the report
+ * (the default), enforce also refuses to run if any check is BAD, and
+ * preflight_skip names checks to leave out. `./p3 --preflight <experiment>`
+ * prints the report alone.
+ */
+#ifndef P3_PREFLIGHT_H
+#define P3_PREFLIGHT_H
+
+#include <string>
+#include <vector>
+
+enum PreflightMode { PREFLIGHT_OFF, PREFLIGHT_WARN, PREFLIGHT_ENFORCE };
+
+// "off" / "warn" / "enforce"; false for an unknown name
+bool PreflightModeFromName(const std::string& name, PreflightMode* mode);
+const char* PreflightModeName(PreflightMode mode);
+
+// False if `name` is not one of the checks above
+bool IsPreflightCheck(const std::string& name);
+
+struct ExperimentSpec;
+
+// Run every check not in spec.preflight_skip and print the report; returns
+// the number of BAD checks
+int RunPreflight(const ExperimentSpec& spec);
+
+#endif
@@ -0,0 +1,109 @@
+#include "p3_rawframes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+void FillRawHeader(RawFrameHeader* header, int rows, int cols, int frames) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, RAW_MAGIC, sizeof(header->magic));
+    header->rows = rows;
+    header->cols = cols;
+    header->frames = frames;
+}
+
+static std::runtime_error RawError(const std::string& path, const char* what) {
+    return std::runtime_error{path + ": " + what + ": " + strerror(errno)};
+}
+
+// Map, prefault and lock a whole file or fail with the file closed
+static void* MapLocked(int fd, size_t bytes, int prot, int flags, const std::string& path) {
+    void* map = mmap(NULL, bytes, prot, flags | MAP_POPULATE, fd, 0);
+    if (map == MAP_FAILED) {
+        std::runtime_error err = RawError(path, "mmap failed");
+        close(fd);
+        throw err;
+    }
+    if (mlock(map, bytes)) {
+        std::runtime_error err = RawError(path, "mlock failed");
+        munmap(map, bytes);
+        close(fd);
+        throw err;
+    }
+    return map;
+}
+
+RawFrameSource::RawFrameSource(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw RawError(path, "cannot open");
+    struct stat st;
+    if (fstat(fd, &st)) {
+        std::runtime_error err = RawError(path, "fstat failed");
+        close(fd);
+        throw err;
+    }
+
+    RawFrameHeader header;
+    if (st.st_size < RAW_HEADER_BYTES || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, RAW_MAGIC, sizeof(header.magic)) != 0 || header.frames == 0 ||
+        (uint64_t)st.st_size < RAW_HEADER_BYTES + (uint64_t)header.frames * header.rows * header.cols) {
+        close(fd);
+        throw std::runtime_error{path + ": not a raw frame file (make one with --decode)"};
+    }
+    rows_ = header.rows;
+    cols_ = header.cols;
+    num_frames_ = header.frames;
+
+    bytes_ = RAW_HEADER_BYTES + (size_t)num_frames_ * rows_ * cols_;
+    map_ = MapLocked(fd, bytes_, PROT_READ, MAP_PRIVATE, path);
+    close(fd);  // the mapping keeps the file referenced
+    frames_ = static_cast<const unsigned char*>(map_) + RAW_HEADER_BYTES;
+}
+
+RawFrameSource::~RawFrameSource() {
+    munlock(map_, bytes_);
+    munmap(map_, bytes_);
+}
+
+std::shared_ptr<const RawFrameSource> SharedRawFrames(const std::string& path) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<const RawFrameSource>> sources;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const RawFrameSource>& source = sources[path];
+    if (!source) source.reset(new RawFrameSource(path));
+    return source;
+}
+
+RawFrameRing::RawFrameRing(const std::string& path, int rows, int cols, int frames)
+    : rows_(rows), cols_(cols), num_frames_(frames) {
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) throw RawError(path, "cannot create");
+    bytes_ = RAW_HEADER_BYTES + (size_t)frames * rows * cols;
+    // Allocate the blocks now so the frame loop never extends the file
+    int err = posix_fallocate(fd_, 0, bytes_);
+    if (err) {
+        close(fd_);
+        errno = err;
+        throw RawError(path, "cannot allocate");
+    }
+    map_ = MapLocked(fd_, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, path);
+    header_ = static_cast<RawFrameHeader*>(map_);
+    FillRawHeader(header_, rows, cols, frames);
+    frames_ = static_cast<unsigned char*>(map_) + RAW_HEADER_BYTES;
+}
+
+RawFrameRing::~RawFrameRing() {
+    msync(map_, bytes_, MS_ASYNC);
+    munlock(map_, bytes_);
+    munmap(map_, bytes_);
+    close(fd_);
+}
+
+void RawFrameRing::Commit(int seq) { __atomic_store_n(&header_->written, (uint64_t)seq + 1, __ATOMIC_RELEASE); }
@@ -0,0 +1,90 @@
+/**
+ * Memory-mapped raw grayscale frame files.
+ *
+ * A raw file is a RAW_HEADER_BYTES header followed by `frames` frames of
+ * rows x cols 8-bit pixels. `./p3 --decode` writes one from the CannyP3
+ * clip once, so a run can read pre-decoded frames with plain loads instead
+ * of running the codec inside the measured thread.
+ *
+ * RawFrameSource maps such a file read-only as an input; RawFrameRing
+ * creates one as an output ring of `frames` slots that edge images are
+ * computed straight into. Both mappings are populated and mlock'ed up
+ * front, like FramePool. SharedRawFrames() hands every reader of one path
+ * the same mapping, so N streams over a clip map and lock it once.
+ */
+#ifndef P3_RAWFRAMES_H
+#define P3_RAWFRAMES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#define RAW_MAGIC "P3GRAY01"
+#define RAW_HEADER_BYTES 4096
+
+struct RawFrameHeader {
+    char magic[8];
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t frames;    // frame slots in the file
+    uint32_t reserved;
+    uint64_t written;   // output rings: frames committed so far
+};
+
+void FillRawHeader(RawFrameHeader* header, int rows, int cols, int frames);
+
+class RawFrameSource {
+   public:
+    // Throws std::runtime_error if the file is missing, malformed or cannot
+    // be mapped and locked
+    explicit RawFrameSource(const std::string& path);
+    ~RawFrameSource();
+
+    RawFrameSource(const RawFrameSource&) = delete;
+    RawFrameSource& operator=(const RawFrameSource&) = delete;
+
+    // Frame i of the clip; wraps around like the video loop in CannyP3
+    const unsigned char* frame(int i) const { return frames_ + (size_t)(i % num_frames_) * rows_ * cols_; }
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    int frames() const { return num_frames_; }
+
+   private:
+    void* map_;
+    size_t bytes_;
+    const unsigned char* frames_;
+    int rows_, cols_, num_frames_;
+};
+
+// The process-wide mapping of `path`, created on first use and kept for
+// the rest of the run. Thread-safe; throws like RawFrameSource.
+std::shared_ptr<const RawFrameSource> SharedRawFrames(const std::string& path);
+
+class RawFrameRing {
+   public:
+    // Creates (or truncates) path with room for `frames` slots.
+    // Throws std::runtime_error on failure.
+    RawFrameRing(const std::string& path, int rows, int cols, int frames);
+    ~RawFrameRing();  // schedules writeback; never waits for it
+
+    RawFrameRing(const RawFrameRing&) = delete;
+    RawFrameRing& operator=(const RawFrameRing&) = delete;
+
+    unsigned char* frame(int slot) { return frames_ + (size_t)slot * rows_ * cols_; }
+    int frames() const { return num_frames_; }
+
+    // Publish frame `seq` (stored in slot seq % frames) to readers of the file
+    void Commit(int seq);
+
+   private:
+    int fd_;
+    void* map_;
+    size_t bytes_;
+    RawFrameHeader* header_;
+    unsigned char* frames_;
+    int rows_, cols_, num_frames_;
+};
+
+#endif
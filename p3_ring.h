@@ -0,0 +1,156 @@
+/**
+ * Bounded lock-free ring buffers.
+ *
+ * SpscRing: single producer, single consumer. Push() and Pop() are
+ * wait-free; PushWait()/PopWait() add a short yield-then-sleep backoff for
+ * pipeline stages that must block.
+ *
+ * MpmcRing: any number of producers and consumers (Vyukov's bounded
+ * queue). Every slot carries a sequence number, so a Push() or Pop() is one
+ * CAS on the shared index plus plain accesses to the claimed slot.
+ *
+ * Storage is inline, so rings are allocated (and locked) with their owner.
+ * FutexWait()/FutexWake() let a consumer sleep on a 32-bit atomic word
+ * until a producer changes it.
+ */
+#ifndef P3_RING_H
+#define P3_RING_H
+
+#include <linux/futex.h>
+#include <sched.h>
+#include <stddef.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <stdint.h>
+
+#include <atomic>
+
+// Backoff for a stage waiting on an empty or full ring: a few yields, then
+// 50us sleeps so a spinning RT stage never starves its core
+inline void RingBackoff(int* spins) {
+    if (++*spins < 16) {
+        sched_yield();
+    } else {
+        struct timespec ts = {0, 50000};
+        nanosleep(&ts, NULL);
+    }
+}
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32-bit");
+
+// Sleep until *word no longer holds `seen` (returns at once if it already
+// moved on, or spuriously; callers re-check their condition)
+inline void FutexWait(std::atomic<uint32_t>* word, uint32_t seen) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+}
+
+inline void FutexWake(std::atomic<uint32_t>* word, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "ring capacity must be a power of two");
+
+   public:
+    bool Push(const T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == N) return false;
+        items_[head & (N - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(T* item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) == tail) return false;
+        *item = items_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    void PushWait(const T& item) {
+        int spins = 0;
+        while (!Push(item)) RingBackoff(&spins);
+    }
+
+    void PopWait(T* item) {
+        int spins = 0;
+        while (!Pop(item)) RingBackoff(&spins);
+    }
+
+    size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+
+   private:
+    // Producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) T items_[N];
+};
+
+template <typename T, size_t N>
+class MpmcRing {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "ring capacity must be a power of two");
+
+   public:
+    MpmcRing() {
+        for (size_t i = 0; i < N; i++) slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    // false if full
+    bool Push(const T& item) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots_[pos & (N - 1)];
+            intptr_t dif = (intptr_t)slot.seq.load(std::memory_order_acquire) - (intptr_t)pos;
+            if (dif == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.item = item;
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // false if empty
+    bool Pop(T* item) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots_[pos & (N - 1)];
+            intptr_t dif = (intptr_t)slot.seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+            if (dif == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    *item = slot.item;
+                    slot.seq.store(pos + N, std::memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Approximate while producers or consumers are active
+    bool empty() const { return head_.load(std::memory_order_seq_cst) == tail_.load(std::memory_order_seq_cst); }
+
+   private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        T item;
+    };
+
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) Slot slots_[N];
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include "p3_sched.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Layout of the kernel's struct sched_attr (SCHED_ATTR_SIZE_VER0)
+struct p3_sched_attr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+int SetSelfDeadline(const DeadlineParams& params) {
+    struct p3_sched_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_runtime = params.runtime_ns;
+    attr.sched_deadline = params.deadline_ns;
+    attr.sched_period = params.period_ns;
+
+    if (syscall(SYS_sched_setattr, 0, &attr, 0) != 0) {
+        return errno;
+    }
+    return 0;
+}
+
+int GetSelfDeadline(DeadlineParams* params) {
+    struct p3_sched_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    if (syscall(SYS_sched_getattr, 0, &attr, sizeof(attr), 0) != 0) {
+        return errno;
+    }
+    if (attr.sched_policy != SCHED_DEADLINE) {
+        return EINVAL;
+    }
+    params->runtime_ns = attr.sched_runtime;
+    params->deadline_ns = attr.sched_deadline;
+    params->period_ns = attr.sched_period;
+    return 0;
+}
+
+const char* DeadlineErrorHint(int err) {
+    switch (err) {
+        case EBUSY:
+            return "admission control rejected the reservation (total bandwidth exceeds the RT limit)";
+        case EPERM:
+            return "not permitted (needs CAP_SYS_NICE, and the CPU affinity must span the whole root domain)";
+        case EINVAL:
+            return "invalid parameters (need 0 < runtime <= deadline <= period, runtime >= 1024 ns)";
+        default:
+            return strerror(err);
+    }
+}
@@ -0,0 +1,34 @@
+/**
+ * SCHED_DEADLINE helpers.
+ *
+ * SCHED_DEADLINE cannot be set through pthread attributes; the thread calls
+ * sched_setattr() on itself once it is running. glibc does not wrap the
+ * syscall on older releases, so it is invoked directly.
+ */
+#ifndef P3_SCHED_H
+#define P3_SCHED_H
+
+#include <sched.h>
+#include <stdint.h>
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+struct DeadlineParams {
+    uint64_t runtime_ns = 0;   // CPU budget per period (WCET reservation)
+    uint64_t deadline_ns = 0;  // relative deadline, runtime <= deadline <= period
+    uint64_t period_ns = 0;
+};
+
+// Switch the calling thread to SCHED_DEADLINE. Returns 0 or an errno value;
+// EBUSY means the kernel's admission control rejected the reservation.
+int SetSelfDeadline(const DeadlineParams& params);
+
+// Read back the calling thread's SCHED_DEADLINE parameters. Returns 0 or errno.
+int GetSelfDeadline(DeadlineParams* params);
+
+// Human-readable reason for a SetSelfDeadline() failure
+const char* DeadlineErrorHint(int err);
+
+#endif
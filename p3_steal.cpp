@@ -0,0 +1,203 @@
+#include "p3_steal.h"
+
+#include <limits.h>
+#include <stdio.h>
+
+#include <stdexcept>
+
+#include "p3_ring.h"
+#include "p3_thread.h"
+
+StealRuntime* g_nrt_runtime = NULL;
+
+static uint64_t Pack(size_t begin, size_t end) { return (uint64_t)begin << 32 | (uint32_t)end; }
+
+// Chase-Lev, with the C11 orderings of Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (PPoPP'13)
+
+bool StealDeque::Push(uint64_t range) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_acquire);
+    if (b - t >= STEAL_DEQUE) return false;
+    items_[b & (STEAL_DEQUE - 1)].store(range, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+bool StealDeque::Pop(uint64_t* range) {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+    *range = items_[b & (STEAL_DEQUE - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // Last item: race the thieves for it
+        bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+bool StealDeque::Steal(uint64_t* range) {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) return false;
+    uint64_t item = items_[t & (STEAL_DEQUE - 1)].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return false;
+    *range = item;
+    return true;
+}
+
+class StealWorker : public ThreadNRT {
+   public:
+    StealWorker(StealRuntime* runtime, int index, int app_id) : ThreadNRT(app_id), runtime_(runtime), index_(index) {}
+
+    void Run() { runtime_->WorkerLoop(index_); }
+
+   private:
+    StealRuntime* runtime_;
+    int index_;
+};
+
+StealRuntime::StealRuntime(int first_app_id, const cpu_set_t& cpus, int workers) {
+    if (workers <= 0) workers = CPU_COUNT(&cpus);
+    int cpu = -1;
+    for (int i = 0; i < workers; i++) {
+        // Next CPU of the set, wrapping around
+        do {
+            cpu = (cpu + 1) % CPU_SETSIZE;
+        } while (!CPU_ISSET(cpu, &cpus));
+        cpus_.push_back(cpu);
+        workers_.emplace_back(new StealWorker(this, i, first_app_id + i));
+        state_.emplace_back(new WorkerState());
+        state_.back()->rng = 0x9e3779b97f4a7c15ULL * (i + 1);
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpu, &one);
+        workers_.back()->SetAffinity(one);
+    }
+}
+
+StealRuntime::~StealRuntime() { Close(); }
+
+void StealRuntime::Start() {
+    for (auto& worker : workers_) worker->Start();
+    started_ = true;
+}
+
+void StealRuntime::ParallelFor(size_t n, StealFn fn, void* ctx, size_t grain) {
+    if (n == 0) return;
+    if (n > UINT32_MAX) throw std::runtime_error{"ParallelFor: more than 2^32 items"};
+    if (!started_) {
+        for (size_t i = 0; i < n; i++) fn(ctx, i, 0);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(batch_mutex_);
+    fn_ = fn;
+    ctx_ = ctx;
+    grain_ = grain > 0 ? grain : 1;
+    total_ = n;
+    done_.store(0);
+    uint32_t finished = finished_.load();
+    active_.store(true);
+    inject_.store(Pack(0, n));
+    generation_.fetch_add(1);
+    FutexWake(&generation_, INT_MAX);
+
+    while (finished_.load() == finished) FutexWait(&finished_, finished);
+}
+
+// Split off upper halves onto our deque until `grain` items are left, then
+// run those; thieves take the halves from the other end
+void StealRuntime::Execute(int index, uint64_t range) {
+    WorkerState& me = *state_[index];
+    size_t begin = range >> 32, end = (uint32_t)range;
+    while (end - begin > grain_) {
+        size_t mid = begin + (end - begin) / 2;
+        if (!me.deque.Push(Pack(mid, end))) break;  // deque full: run the rest here
+        end = mid;
+    }
+    for (size_t i = begin; i < end; i++) fn_(ctx_, i, index);
+
+    // The batch cannot finish before our own add, so total_ is still this
+    // batch's here; once we have added, the next ParallelFor may rewrite it
+    size_t count = end - begin, total = total_;
+    me.items += count;
+    if (done_.fetch_add(count) + count == total) {
+        active_.store(false);
+        finished_.fetch_add(1);
+        FutexWake(&finished_, INT_MAX);
+    }
+}
+
+bool StealRuntime::StealOne(int index, uint64_t* range) {
+    WorkerState& me = *state_[index];
+    int n = workers();
+    for (int attempt = 0; attempt < 2 * n; attempt++) {
+        // xorshift64
+        me.rng ^= me.rng << 13;
+        me.rng ^= me.rng >> 7;
+        me.rng ^= me.rng << 17;
+        int victim = (int)(me.rng % n);
+        if (victim != index && state_[victim]->deque.Steal(range)) {
+            me.steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void StealRuntime::WorkerLoop(int index) {
+    WorkerState& me = *state_[index];
+    int spins = 0;
+    for (;;) {
+        uint64_t range;
+        bool got = me.deque.Pop(&range);
+        if (!got && inject_.load() != 0) {
+            range = inject_.exchange(0);
+            got = range != 0;
+            if (got) me.batches++;
+        }
+        if (!got) got = StealOne(index, &range);
+        if (got) {
+            Execute(index, range);
+            spins = 0;
+            continue;
+        }
+
+        // A batch is still running elsewhere: keep looking for halves
+        if (active_.load()) {
+            RingBackoff(&spins);
+            continue;
+        }
+
+        // Nothing to do until the next batch (or Close)
+        uint32_t gen = generation_.load();
+        if (stopping_.load()) return;
+        if (active_.load() || inject_.load() != 0) continue;
+        FutexWait(&generation_, gen);
+    }
+}
+
+void StealRuntime::Close() {
+    if (!started_) return;
+    started_ = false;
+    stopping_.store(true);
+    generation_.fetch_add(1);
+    FutexWake(&generation_, INT_MAX);
+    for (auto& worker : workers_) worker->Join();
+
+    for (size_t i = 0; i < workers_.size(); i++) {
+        const WorkerState& s = *state_[i];
+        printf("Steal worker App #%d (CPU %d): %ld items, %ld steals, %ld batches started\n", workers_[i]->app_id_,
+               cpus_[i], s.items, s.steals, s.batches);
+    }
+}
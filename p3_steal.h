@@ -0,0 +1,106 @@
+/**
+ * Work-stealing task runtime for NRT batch work.
+ *
+ * SCHED_OTHER workers pinned round robin to a set of CPUs (by default the
+ * cores no RT thread is pinned to, one each, see NrtCpus()), each with its
+ * own lock-free Chase-Lev deque of index ranges. ParallelFor(n, ...) hands the whole range [0, n) to the
+ * workers; a worker splits the range it holds in halves, pushing the upper
+ * half onto its own deque, until it is down to `grain` items, and runs
+ * those. Idle workers steal the oldest (largest) range from a randomly
+ * chosen victim, so a batch spreads over every free core without a shared
+ * queue. Between batches the workers sleep on a futex.
+ *
+ * One batch runs at a time; concurrent ParallelFor() callers queue on a
+ * mutex. fn(ctx, i, worker) gets the worker index, 0..workers()-1, for
+ * per-worker scratch.
+ */
+#ifndef P3_STEAL_H
+#define P3_STEAL_H
+
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define STEAL_DEQUE 1024  // ranges per worker deque (power of two)
+
+typedef void (*StealFn)(void* ctx, size_t index, int worker);
+
+// Chase-Lev work-stealing deque of packed [begin, end) ranges. The owner
+// pushes and pops at the bottom; thieves take from the top.
+class StealDeque {
+   public:
+    bool Push(uint64_t range);   // owner; false if full
+    bool Pop(uint64_t* range);   // owner
+    bool Steal(uint64_t* range); // any thread; false if empty or lost a race
+
+   private:
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    std::atomic<uint64_t> items_[STEAL_DEQUE];
+};
+
+class StealWorker;
+
+class StealRuntime {
+   public:
+    // `workers` workers (0 = one per CPU of `cpus`), each pinned to the next
+    // CPU of the set. Workers are App #first_app_id, ... Construct before
+    // LockMemory().
+    StealRuntime(int first_app_id, const cpu_set_t& cpus, int workers);
+    ~StealRuntime();
+
+    StealRuntime(const StealRuntime&) = delete;
+    StealRuntime& operator=(const StealRuntime&) = delete;
+
+    void Start();
+
+    // Run fn(ctx, i, worker) for every i in [0, n); returns when all are done
+    void ParallelFor(size_t n, StealFn fn, void* ctx, size_t grain = 1);
+
+    // Join the workers and print per-worker items and steals
+    void Close();
+
+    int workers() const { return (int)workers_.size(); }
+
+   private:
+    friend class StealWorker;
+    void WorkerLoop(int index);
+    void Execute(int index, uint64_t range);
+    bool StealOne(int index, uint64_t* range);
+
+    struct WorkerState {
+        StealDeque deque;
+        uint64_t rng;
+        long items = 0;
+        long steals = 0;
+        long batches = 0;
+    };
+
+    std::vector<std::unique_ptr<StealWorker>> workers_;
+    std::vector<std::unique_ptr<WorkerState>> state_;
+    std::vector<int> cpus_;
+
+    // Current batch
+    std::mutex batch_mutex_;  // one ParallelFor at a time
+    StealFn fn_ = NULL;
+    void* ctx_ = NULL;
+    size_t grain_ = 1;
+    size_t total_ = 0;
+    alignas(64) std::atomic<uint64_t> inject_{0};    // whole batch, until a worker takes it
+    alignas(64) std::atomic<size_t> done_{0};        // items finished
+    alignas(64) std::atomic<uint32_t> generation_{0};  // futex: bumped per batch and at Close()
+    alignas(64) std::atomic<uint32_t> finished_{0};    // futex: bumped when a batch completes
+    std::atomic<bool> active_{false};
+    std::atomic<bool> stopping_{false};
+    bool started_ = false;
+};
+
+// The experiment's NRT runtime ([experiment] steal_workers), or NULL
+extern StealRuntime* g_nrt_runtime;
+
+#endif
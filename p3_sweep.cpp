@@ -0,0 +1,517 @@
+#include "p3_sweep.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+enum SweepAxis { AXIS_POLICY, AXIS_PRIORITY, AXIS_CPUS, AXIS_RT_THREADS, AXIS_NRT_THREADS, AXIS_STREAMS, NUM_AXES };
+
+static const char* kAxisNames[NUM_AXES] = {"policy", "priority", "cpus", "rt_threads", "nrt_threads", "streams"};
+
+struct SweepSpec {
+    std::string experiment;
+    int runs = 5;
+    std::vector<std::string> axes[NUM_AXES];  // empty = not swept
+    std::string csv, json, baseline;
+    std::string log = "/dev/null";
+    double tolerance_pct = 5;
+};
+
+// One point of the cross product; "" for axes that are not swept
+struct SweepConfig {
+    std::string value[NUM_AXES];
+};
+
+enum SweepMetric { METRIC_RUNTIME, METRIC_CPU, METRIC_LAT_AVG, METRIC_LAT_P99, METRIC_LAT_MAX, METRIC_OVERRUNS,
+                   NUM_METRICS };
+
+static const char* kMetricNames[NUM_METRICS] = {"runtime_sec", "cpu_sec",    "lat_avg_us",
+                                                "lat_p99_us",  "lat_max_us", "overruns"};
+
+static std::string Trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t\r");
+    if (b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r");
+    return s.substr(b, e - b + 1);
+}
+
+static SweepSpec LoadSweepFile(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) throw std::runtime_error{"cannot open sweep file " + path};
+
+    SweepSpec sweep;
+    std::string line, section;
+    int lineno = 0;
+    while (std::getline(file, line)) {
+        lineno++;
+        std::string where = path + ":" + std::to_string(lineno);
+
+        // Same comment rules as experiment files
+        for (size_t i = 0; i < line.size(); i++) {
+            if ((i == 0 && line[i] == '#') || (line[i] == ';' && (i == 0 || line[i - 1] == ' ' || line[i - 1] == '\t'))) {
+                line.erase(i);
+                break;
+            }
+        }
+        line = Trim(line);
+        if (line.empty()) continue;
+        if (line.front() == '[') {
+            section = Trim(line.substr(1, line.size() - 2));
+            if (line.back() != ']' || section != "sweep") throw std::runtime_error{where + ": expected [sweep]"};
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (section.empty() || eq == std::string::npos) throw std::runtime_error{where + ": expected key = value"};
+        std::string key = Trim(line.substr(0, eq));
+        std::string value = Trim(line.substr(eq + 1));
+
+        int axis = -1;
+        for (int a = 0; a < NUM_AXES; a++) {
+            if (key == kAxisNames[a]) axis = a;
+        }
+        if (axis >= 0) {
+            std::istringstream values(value);
+            std::string v;
+            while (values >> v) sweep.axes[axis].push_back(v);
+            if (sweep.axes[axis].empty()) throw std::runtime_error{where + ": " + key + " needs values"};
+        } else if (key == "experiment") {
+            sweep.experiment = value;
+        } else if (key == "runs") {
+            sweep.runs = atoi(value.c_str());
+            if (sweep.runs < 1) throw std::runtime_error{where + ": runs must be >= 1"};
+        } else if (key == "csv") {
+            sweep.csv = value;
+        } else if (key == "json") {
+            sweep.json = value;
+        } else if (key == "log") {
+            sweep.log = value;
+        } else if (key == "baseline") {
+            sweep.baseline = value;
+        } else if (key == "tolerance") {
+            sweep.tolerance_pct = atof(value.c_str());
+        } else {
+            throw std::runtime_error{where + ": unknown key '" + key + "'"};
+        }
+    }
+    if (sweep.experiment.empty()) throw std::runtime_error{path + ": no experiment"};
+    return sweep;
+}
+
+static ExperimentSpec LoadBase(const std::string& experiment) {
+    if (experiment.find_first_not_of("0123456789") == std::string::npos) {
+        return BuiltinExperiment(atoi(experiment.c_str()));
+    }
+    return LoadExperimentFile(experiment);
+}
+
+// Replace the threads of class `cls` with `count` copies of the first one,
+// where that one stood
+static void ResizeClass(std::vector<ThreadSpec>* threads, ThreadClass cls, int count, const std::string& where) {
+    size_t first = 0;
+    while (first < threads->size() && (*threads)[first].cls != cls) first++;
+    if (first == threads->size()) {
+        if (count == 0) return;
+        throw std::runtime_error{where + ": no " + ThreadClassName(cls) + " thread to copy"};
+    }
+    ThreadSpec model = (*threads)[first];
+    std::vector<ThreadSpec> out;
+    for (size_t i = 0; i < threads->size(); i++) {
+        if (i == first) out.insert(out.end(), count, model);
+        if ((*threads)[i].cls != cls) out.push_back((*threads)[i]);
+    }
+    *threads = out;
+}
+
+// Fold every expanded `streams` group back into its first stream and give
+// it `count` streams; CheckExperiment() expands it again
+static void SetStreams(std::vector<ThreadSpec>* threads, const std::string& count, const std::string& where) {
+    std::vector<ThreadSpec> out;
+    bool found = false;
+    for (ThreadSpec& t : *threads) {
+        if (t.stream > 0) continue;
+        out.push_back(t);
+        if (t.stream == 0) {
+            SetThreadKey(&out.back(), "streams", count, where);
+            found = true;
+        }
+    }
+    if (!found) throw std::runtime_error{where + ": no thread with streams to resize"};
+    for (ThreadSpec& t : out) t.app_id = 0;  // renumbered by position
+    *threads = out;
+}
+
+static ExperimentSpec ApplyConfig(const ExperimentSpec& base, const SweepConfig& config, const std::string& where) {
+    ExperimentSpec spec = base;
+    spec.trace.clear();  // one trace per run would overwrite itself
+
+    const std::string& rt = config.value[AXIS_RT_THREADS];
+    const std::string& nrt = config.value[AXIS_NRT_THREADS];
+    if (!rt.empty() || !nrt.empty()) {
+        if (!rt.empty()) ResizeClass(&spec.threads, THREAD_RT, atoi(rt.c_str()), where);
+        if (!nrt.empty()) ResizeClass(&spec.threads, THREAD_NRT, atoi(nrt.c_str()), where);
+        for (ThreadSpec& t : spec.threads) t.app_id = 0;  // renumbered by position
+    }
+    if (!config.value[AXIS_STREAMS].empty()) SetStreams(&spec.threads, config.value[AXIS_STREAMS], where);
+    for (ThreadSpec& t : spec.threads) {
+        if (t.cls == THREAD_RT) {
+            if (!config.value[AXIS_POLICY].empty()) SetThreadKey(&t, "policy", config.value[AXIS_POLICY], where);
+            if (!config.value[AXIS_PRIORITY].empty()) SetThreadKey(&t, "priority", config.value[AXIS_PRIORITY], where);
+        }
+        if (!config.value[AXIS_CPUS].empty()) SetThreadKey(&t, "cpus", config.value[AXIS_CPUS], where);
+    }
+    CheckExperiment(&spec, where);
+    return spec;
+}
+
+static std::vector<SweepConfig> CrossProduct(const SweepSpec& sweep) {
+    std::vector<SweepConfig> configs(1);
+    for (int a = 0; a < NUM_AXES; a++) {
+        if (sweep.axes[a].empty()) continue;
+        std::vector<SweepConfig> next;
+        for (const SweepConfig& c : configs) {
+            for (const std::string& v : sweep.axes[a]) {
+                next.push_back(c);
+                next.back().value[a] = v;
+            }
+        }
+        configs = next;
+    }
+    return configs;
+}
+
+static std::string ConfigLabel(const SweepConfig& config) {
+    std::string label;
+    for (int a = 0; a < NUM_AXES; a++) {
+        if (config.value[a].empty()) continue;
+        if (!label.empty()) label += " ";
+        label += std::string(kAxisNames[a]) + "=" + config.value[a];
+    }
+    return label.empty() ? "as written" : label;
+}
+
+// One run in a forked child, its stdout appended to the log; the results
+// come back over a pipe, one line per app. False if the run failed.
+static bool RunOnce(const ExperimentSpec& spec, ExperimentRunner run, const std::string& log,
+                    std::vector<AppResult>* results) {
+    int fds[2];
+    if (pipe(fds)) {
+        perror("sweep: pipe");
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("sweep: fork");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        int out = open(log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (out >= 0) {
+            dup2(out, STDOUT_FILENO);
+            close(out);
+        }
+        FILE* pipe_out = fdopen(fds[1], "w");
+        int status = 0;
+        try {
+            for (const AppResult& r : run(spec)) {
+                fprintf(pipe_out, "%d %d %.9f %.9f %d %d %ld %.3f %.3f %.3f %s\n", r.app_id, (int)r.cls,
+                        r.runtime_sec, r.cpu_sec, (int)r.periodic, r.cycles, r.overruns, r.lat_avg_us, r.lat_p99_us,
+                        r.lat_max_us, r.workload.c_str());
+            }
+        } catch (const std::exception& e) {
+            fprintf(stderr, "sweep run: %s\n", e.what());
+            status = 1;
+        }
+        fclose(pipe_out);
+        fflush(stdout);
+        _exit(status);
+    }
+
+    close(fds[1]);
+    std::string text;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) text.append(buf, n);
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return false;
+
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        AppResult r;
+        int cls, periodic;
+        char workload[64];
+        if (sscanf(line.c_str(), "%d %d %lf %lf %d %d %ld %lf %lf %lf %63s", &r.app_id, &cls, &r.runtime_sec,
+                   &r.cpu_sec, &periodic, &r.cycles, &r.overruns, &r.lat_avg_us, &r.lat_p99_us, &r.lat_max_us,
+                   workload) != 11) {
+            return false;
+        }
+        r.cls = (ThreadClass)cls;
+        r.periodic = periodic != 0;
+        r.workload = workload;
+        results->push_back(r);
+    }
+    return true;
+}
+
+struct Stat {
+    size_t n = 0;
+    double mean = 0, stddev = 0, lo = 0, hi = 0, min = 0, max = 0;
+};
+
+// Two-sided 95% Student-t quantiles for 1..30 degrees of freedom
+static const double kT95[30] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+static Stat Summarize(const std::vector<double>& v) {
+    Stat s;
+    s.n = v.size();
+    if (s.n == 0) return s;
+    s.min = s.max = v[0];
+    for (double x : v) {
+        s.mean += x;
+        s.min = std::min(s.min, x);
+        s.max = std::max(s.max, x);
+    }
+    s.mean /= s.n;
+    if (s.n > 1) {
+        double ss = 0;
+        for (double x : v) ss += (x - s.mean) * (x - s.mean);
+        s.stddev = sqrt(ss / (s.n - 1));
+    }
+    double t = s.n < 2 ? 0 : s.n - 1 <= 30 ? kT95[s.n - 2] : 1.96;
+    double half = t * s.stddev / sqrt((double)s.n);
+    s.lo = s.mean - half;
+    s.hi = s.mean + half;
+    return s;
+}
+
+struct SweepRow {
+    int config;
+    int app_id;
+    ThreadClass cls;
+    std::string workload;
+    int metric;
+    Stat stat;
+};
+
+// Baseline rows are matched on the axis values, app and metric
+static std::string RowKey(const SweepConfig& config, int app_id, const std::string& metric) {
+    std::string key;
+    for (int a = 0; a < NUM_AXES; a++) key += (config.value[a].empty() ? "-" : config.value[a]) + "|";
+    return key + std::to_string(app_id) + "|" + metric;
+}
+
+static std::string CsvField(const std::string& s) {
+    return s.find(',') == std::string::npos ? s : "\"" + s + "\"";
+}
+
+static std::vector<std::string> SplitCsv(const std::string& line) {
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (char c : line) {
+        if (c == '"') {
+            quoted = !quoted;
+        } else if (c == ',' && !quoted) {
+            fields.emplace_back();
+        } else if (c != '\r') {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+#define CSV_HEADER \
+    "config,policy,priority,cpus,rt_threads,nrt_threads,streams,app_id,class,workload,metric,n,mean,stddev,ci95_low," \
+    "ci95_high,min,max"
+
+static bool WriteCsv(const std::string& path, const std::vector<SweepConfig>& configs, const std::vector<SweepRow>& rows) {
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) {
+        perror(path.c_str());
+        return false;
+    }
+    fprintf(out, "%s\n", CSV_HEADER);
+    for (const SweepRow& r : rows) {
+        fprintf(out, "%d", r.config);
+        for (int a = 0; a < NUM_AXES; a++) {
+            const std::string& v = configs[r.config].value[a];
+            fprintf(out, ",%s", v.empty() ? "-" : CsvField(v).c_str());
+        }
+        const Stat& s = r.stat;
+        fprintf(out, ",%d,%s,%s,%s,%zu,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n", r.app_id, ThreadClassName(r.cls),
+                r.workload.c_str(), kMetricNames[r.metric], s.n, s.mean, s.stddev, s.lo, s.hi, s.min, s.max);
+    }
+    fclose(out);
+    return true;
+}
+
+static bool WriteJson(const std::string& path, const SweepSpec& sweep, const std::vector<SweepConfig>& configs,
+                      const std::vector<SweepRow>& rows) {
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) {
+        perror(path.c_str());
+        return false;
+    }
+    fprintf(out, "{\"experiment\":\"%s\",\"runs\":%d,\"results\":[", sweep.experiment.c_str(), sweep.runs);
+    for (size_t i = 0; i < rows.size(); i++) {
+        const SweepRow& r = rows[i];
+        fprintf(out, "%s\n{\"config\":%d", i ? "," : "", r.config);
+        for (int a = 0; a < NUM_AXES; a++) {
+            const std::string& v = configs[r.config].value[a];
+            if (!v.empty()) fprintf(out, ",\"%s\":\"%s\"", kAxisNames[a], v.c_str());
+        }
+        const Stat& s = r.stat;
+        fprintf(out,
+                ",\"app_id\":%d,\"class\":\"%s\",\"workload\":\"%s\",\"metric\":\"%s\",\"n\":%zu,\"mean\":%.9g,"
+                "\"stddev\":%.9g,\"ci95\":[%.9g,%.9g],\"min\":%.9g,\"max\":%.9g}",
+                r.app_id, ThreadClassName(r.cls), r.workload.c_str(), kMetricNames[r.metric], s.n, s.mean,
+                s.stddev, s.lo, s.hi, s.min, s.max);
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    return true;
+}
+
+// Compare against an earlier csv; returns the number of regressions
+static int CheckBaseline(const SweepSpec& sweep, const std::vector<SweepConfig>& configs,
+                         const std::vector<SweepRow>& rows) {
+    std::ifstream file(sweep.baseline);
+    if (!file) throw std::runtime_error{"cannot open baseline " + sweep.baseline};
+
+    struct Base {
+        double mean, lo, hi;
+    };
+    std::map<std::string, Base> base;
+    std::string line;
+    std::getline(file, line);
+    if (Trim(line) != CSV_HEADER) throw std::runtime_error{sweep.baseline + ": not a sweep csv"};
+    while (std::getline(file, line)) {
+        std::vector<std::string> f = SplitCsv(line);
+        if (f.size() != 12 + NUM_AXES) continue;
+        SweepConfig c;
+        for (int a = 0; a < NUM_AXES; a++) c.value[a] = f[1 + a] == "-" ? "" : f[1 + a];
+        const std::string* row = &f[1 + NUM_AXES];  // app_id onwards
+        base[RowKey(c, atoi(row[0].c_str()), row[3])] = {atof(row[5].c_str()), atof(row[7].c_str()),
+                                                         atof(row[8].c_str())};
+    }
+
+    int regressions = 0, compared = 0;
+    for (const SweepRow& r : rows) {
+        auto it = base.find(RowKey(configs[r.config], r.app_id, kMetricNames[r.metric]));
+        if (it == base.end()) continue;
+        compared++;
+        const Base& b = it->second;
+        double change = b.mean != 0 ? (r.stat.mean - b.mean) / fabs(b.mean) * 100 : 0;
+        const char* verdict = NULL;
+        if (change > sweep.tolerance_pct && r.stat.lo > b.hi) {
+            verdict = "REGRESSION";
+            regressions++;
+        } else if (change < -sweep.tolerance_pct && r.stat.hi < b.lo) {
+            verdict = "improved";
+        }
+        if (verdict) {
+            printf("%s: [%s] App #%d %s %.6g -> %.6g (%+.1f%%)\n", verdict, ConfigLabel(configs[r.config]).c_str(),
+                   r.app_id, kMetricNames[r.metric], b.mean, r.stat.mean, change);
+        }
+    }
+    printf("Baseline %s: %d metrics compared, %d regressions (tolerance %.1f%%)\n", sweep.baseline.c_str(), compared,
+           regressions, sweep.tolerance_pct);
+    return regressions;
+}
+
+int RunSweep(const std::string& path, ExperimentRunner run) {
+    SweepSpec sweep;
+    ExperimentSpec base;
+    std::vector<SweepConfig> configs;
+    std::vector<ExperimentSpec> specs;
+    try {
+        sweep = LoadSweepFile(path);
+        base = LoadBase(sweep.experiment);
+        configs = CrossProduct(sweep);
+        // Reject impossible configurations before spending minutes on runs
+        for (size_t c = 0; c < configs.size(); c++) {
+            specs.push_back(ApplyConfig(base, configs[c], path + ": [" + ConfigLabel(configs[c]) + "]"));
+        }
+    } catch (const std::exception& e) {
+        printf("ERROR: %s\n", e.what());
+        return 1;
+    }
+    printf("Sweep %s: %zu configurations x %d runs of %s\n", path.c_str(), configs.size(), sweep.runs,
+           sweep.experiment.c_str());
+
+    std::vector<SweepRow> rows;
+    for (size_t c = 0; c < configs.size(); c++) {
+        struct AppSamples {
+            ThreadClass cls;
+            std::string workload;
+            bool periodic;
+            std::vector<double> metric[NUM_METRICS];
+        };
+        std::map<int, AppSamples> apps;
+        int failed = 0;
+        for (int r = 0; r < sweep.runs; r++) {
+            std::vector<AppResult> results;
+            if (!RunOnce(specs[c], run, sweep.log, &results)) {
+                failed++;
+                continue;
+            }
+            for (const AppResult& a : results) {
+                AppSamples& s = apps[a.app_id];
+                s.cls = a.cls;
+                s.workload = a.workload;
+                s.periodic = a.periodic;
+                s.metric[METRIC_RUNTIME].push_back(a.runtime_sec);
+                s.metric[METRIC_CPU].push_back(a.cpu_sec);
+                if (a.periodic) {
+                    s.metric[METRIC_LAT_AVG].push_back(a.lat_avg_us);
+                    s.metric[METRIC_LAT_P99].push_back(a.lat_p99_us);
+                    s.metric[METRIC_LAT_MAX].push_back(a.lat_max_us);
+                    s.metric[METRIC_OVERRUNS].push_back((double)a.overruns);
+                }
+            }
+        }
+
+        printf("[%zu/%zu] %s: %d/%d runs ok\n", c + 1, configs.size(), ConfigLabel(configs[c]).c_str(),
+               sweep.runs - failed, sweep.runs);
+        for (auto& app : apps) {
+            for (int m = 0; m < NUM_METRICS; m++) {
+                if (app.second.metric[m].empty()) continue;
+                SweepRow row = {(int)c, app.first, app.second.cls, app.second.workload, m,
+                                Summarize(app.second.metric[m])};
+                rows.push_back(row);
+                printf("  App #%d %-11s mean %.6g +/- %.3g (95%% CI, sd %.3g, n %zu)\n", app.first, kMetricNames[m],
+                       row.stat.mean, row.stat.hi - row.stat.mean, row.stat.stddev, row.stat.n);
+            }
+        }
+    }
+
+    bool ok = true;
+    if (!sweep.csv.empty()) ok &= WriteCsv(sweep.csv, configs, rows);
+    if (!sweep.json.empty()) ok &= WriteJson(sweep.json, sweep, configs, rows);
+    if (!sweep.baseline.empty()) {
+        try {
+            if (CheckBaseline(sweep, configs, rows) > 0) return 2;
+        } catch (const std::exception& e) {
+            printf("ERROR: %s\n", e.what());
+            return 1;
+        }
+    }
+    return ok ? 0 : 1;
+}
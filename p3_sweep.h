@@ -0,0 +1,61 @@
+/**
+ * Repeated, parameter-swept experiment runs with statistics.
+ *
+ * A sweep file names one experiment and the axes to vary:
+ *
+ *   [sweep]
+ *   experiment = experiments/periodic_canny_vs_nrt.ini  ; or a built-in id
+ *   runs = 10               ; repetitions per configuration
+ *   policy = fifo rr        ; RT threads; values are space-separated
+ *   priority = 50 80        ; RT threads
+ *   cpus = 1 any            ; every thread
+ *   rt_threads = 1 2        ; copies of the first RT thread
+ *   nrt_threads = 0 2 4     ; copies of the first NRT thread
+ *   streams = 1 2 4         ; size of every `streams` canny group
+ *   csv = sweep.csv
+ *   json = sweep.json
+ *   log = sweep.log         ; the runs' own output (default /dev/null)
+ *   baseline = baseline.csv ; a csv from an earlier sweep
+ *   tolerance = 5           ; percent a mean may grow before it regresses
+ *
+ * Every configuration in the cross product runs `runs` times, each in a
+ * forked child so runs share no heap, locks or calibration state. Per app
+ * and metric (runtime, on-CPU time and, for periodic apps, wakeup latency
+ * and overruns) the sweep reports n, mean, standard deviation, a 95%
+ * Student-t confidence interval of the mean, min and max.
+ *
+ * With a baseline, a metric regresses when its mean grew by more than the
+ * tolerance and its interval lies entirely above the baseline's, i.e. the
+ * change is larger than the run-to-run noise of either sweep. All metrics
+ * are lower-is-better. RunSweep() returns 2 if anything regressed.
+ */
+#ifndef P3_SWEEP_H
+#define P3_SWEEP_H
+
+#include <string>
+#include <vector>
+
+#include "p3_experiment.h"
+
+// One app's outcome in one run (pipeline stages are not reported)
+struct AppResult {
+    int app_id = 0;
+    ThreadClass cls = THREAD_NRT;
+    std::string workload;
+    double runtime_sec = 0;
+    double cpu_sec = 0;
+    bool periodic = false;  // the fields below are valid only if set
+    int cycles = 0;
+    long overruns = 0;
+    double lat_avg_us = 0;
+    double lat_p99_us = 0;
+    double lat_max_us = 0;
+};
+
+typedef std::vector<AppResult> (*ExperimentRunner)(const ExperimentSpec& spec);
+
+// Run the sweep file at `path` with `run` (RunExperiment). Returns the
+// process exit code: 0, 1 on errors, 2 if the baseline check failed.
+int RunSweep(const std::string& path, ExperimentRunner run);
+
+#endif
@@ -0,0 +1,73 @@
+#include "p3_sync.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+#include "p3_timing.h"
+#include "p3_trace.h"
+
+static const char* kProtocolNames[] = {"none", "inherit", "protect"};
+
+bool MutexProtocolFromName(const char* name, MutexProtocol* protocol) {
+    for (int i = 0; i <= MUTEX_PROTECT; i++) {
+        if (strcmp(name, kProtocolNames[i]) == 0) {
+            *protocol = (MutexProtocol)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* MutexProtocolName(MutexProtocol protocol) { return kProtocolNames[protocol]; }
+
+RtMutex::RtMutex(MutexProtocol protocol, int ceiling) : protocol_(protocol), ceiling_(ceiling) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    int err = 0;
+    if (protocol == MUTEX_INHERIT) {
+        err = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    } else if (protocol == MUTEX_PROTECT) {
+        err = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_PROTECT);
+        if (!err) err = pthread_mutexattr_setprioceiling(&attr, ceiling);
+    }
+    if (!err) err = pthread_mutex_init(&mutex_, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (err) {
+        throw std::runtime_error{std::string("RtMutex (") + MutexProtocolName(protocol) + "): " + strerror(err)};
+    }
+}
+
+RtMutex::~RtMutex() { pthread_mutex_destroy(&mutex_); }
+
+long RtMutex::Lock() {
+    int err = pthread_mutex_trylock(&mutex_);
+    if (err == 0) return 0;
+    if (err != EBUSY) return -1;
+
+    // Contended: time the wait and show it on the trace timeline
+    Trace(TRACE_LOCK_WAIT_BEGIN);
+    uint64_t start = TimingNowNs();
+    err = pthread_mutex_lock(&mutex_);
+    long waited = (long)(TimingNowNs() - start);
+    Trace(TRACE_LOCK_WAIT_END);
+    return err ? -1 : waited;
+}
+
+void RtMutex::Unlock() { pthread_mutex_unlock(&mutex_); }
+
+// Only touched by the main thread, before the apps start
+static std::map<std::string, std::unique_ptr<RtMutex>> g_shared_mutexes;
+
+RtMutex* SharedMutex(const std::string& name, MutexProtocol protocol, int ceiling) {
+    std::unique_ptr<RtMutex>& slot = g_shared_mutexes[name];
+    if (!slot) {
+        slot.reset(new RtMutex(protocol, ceiling));
+    } else if (slot->protocol() != protocol || (protocol == MUTEX_PROTECT && slot->ceiling() != ceiling)) {
+        throw std::runtime_error{"lock '" + name + "' is used with different protocols or ceilings"};
+    }
+    return slot.get();
+}
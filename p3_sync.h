@@ -0,0 +1,61 @@
+/**
+ * Priority-aware mutexes shared between apps.
+ *
+ * RtMutex wraps a pthread mutex with one of the POSIX locking protocols:
+ *
+ *   none    - plain mutex; a low-priority holder can be preempted by a
+ *             medium-priority thread while an RT waiter stays blocked
+ *             (unbounded priority inversion)
+ *   inherit - PTHREAD_PRIO_INHERIT: the holder runs at the priority of its
+ *             highest waiter until it unlocks (kernel rt_mutex / PI futex)
+ *   protect - PTHREAD_PRIO_PROTECT: the holder always runs at the ceiling
+ *             while it holds the lock (priority ceiling protocol)
+ *
+ * Lock() reports how long the caller was blocked, so each app can build a
+ * histogram of the inversion it saw. Apps find a shared mutex by name with
+ * SharedMutex(); the mutexes are created by the main thread while the apps
+ * are built and live until exit.
+ */
+#ifndef P3_SYNC_H
+#define P3_SYNC_H
+
+#include <pthread.h>
+
+#include <string>
+
+enum MutexProtocol { MUTEX_NONE, MUTEX_INHERIT, MUTEX_PROTECT };
+
+// "none" / "inherit" / "protect"; false if unknown
+bool MutexProtocolFromName(const char* name, MutexProtocol* protocol);
+const char* MutexProtocolName(MutexProtocol protocol);
+
+class RtMutex {
+   public:
+    // ceiling is the SCHED_FIFO priority used by MUTEX_PROTECT (ignored
+    // otherwise). Throws std::runtime_error if the protocol is unsupported.
+    explicit RtMutex(MutexProtocol protocol, int ceiling = 99);
+    ~RtMutex();
+
+    RtMutex(const RtMutex&) = delete;
+    RtMutex& operator=(const RtMutex&) = delete;
+
+    // Returns the nanoseconds spent blocked (0 if the lock was free), or -1
+    // on error (e.g. EINVAL: caller's priority above the ceiling)
+    long Lock();
+    void Unlock();
+
+    MutexProtocol protocol() const { return protocol_; }
+    int ceiling() const { return ceiling_; }
+
+   private:
+    pthread_mutex_t mutex_;
+    MutexProtocol protocol_;
+    int ceiling_;
+};
+
+// The process-wide mutex called `name`, created on first use. Every user
+// must ask for the same protocol and ceiling; throws std::runtime_error
+// otherwise. Call from the main thread while building apps.
+RtMutex* SharedMutex(const std::string& name, MutexProtocol protocol, int ceiling);
+
+#endif
@@ -0,0 +1,253 @@
+#include "p3_thermal.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "p3_experiment.h"
+#include "p3_framepool.h"
+#include "p3_thread.h"
+#include "p3_timing.h"
+
+ThermalSampler* g_thermal_sampler = NULL;
+
+#define TEMP_UNKNOWN INT32_MIN
+
+// First integer in a sysfs file kept open; false if unreadable
+static bool ReadValue(int fd, long* value, int base = 10) {
+    char buf[32];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) return false;
+    buf[n] = '\0';
+    char* end;
+    *value = strtol(buf, &end, base);
+    return end != buf;
+}
+
+static std::string ReadText(const std::string& path) {
+    char buf[64] = {0};
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) return "";
+    if (!fgets(buf, sizeof(buf), f)) buf[0] = '\0';
+    fclose(f);
+    buf[strcspn(buf, "\n")] = '\0';
+    return buf;
+}
+
+// The SoC zone: the first whose type names the CPU or package, else zone 0
+static std::string FindThermalZone(std::string* type) {
+    static const char* kPreferred[] = {"cpu-thermal", "cpu_thermal", "soc", "x86_pkg_temp"};
+    std::vector<std::string> zones;
+    if (DIR* dir = opendir("/sys/class/thermal")) {
+        while (struct dirent* e = readdir(dir)) {
+            if (strncmp(e->d_name, "thermal_zone", 12) == 0) zones.push_back(e->d_name);
+        }
+        closedir(dir);
+    }
+    std::sort(zones.begin(), zones.end());
+    for (const char* want : kPreferred) {
+        for (const std::string& zone : zones) {
+            std::string t = ReadText("/sys/class/thermal/" + zone + "/type");
+            if (t.find(want) != std::string::npos) {
+                *type = t;
+                return "/sys/class/thermal/" + zone + "/temp";
+            }
+        }
+    }
+    if (zones.empty()) return "";
+    *type = ReadText("/sys/class/thermal/" + zones[0] + "/type");
+    return "/sys/class/thermal/" + zones[0] + "/temp";
+}
+
+ThermalSampler::ThermalSampler(int interval_ms, bool trace) : interval_ns_(interval_ms * 1000000L) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/scaling_cur_freq";
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno == ENOENT && access(("/sys/devices/system/cpu/cpu" + std::to_string(cpu)).c_str(), F_OK) != 0) {
+                break;  // past the last CPU
+            }
+            continue;
+        }
+        freq_cpus_.push_back(cpu);
+        freq_fds_.push_back(fd);
+    }
+    std::string temp = FindThermalZone(&zone_);
+    if (!temp.empty()) temp_fd_ = open(temp.c_str(), O_RDONLY | O_CLOEXEC);
+
+    // Raspberry Pi firmware driver; its platform path differs by board
+    glob_t found;
+    if (glob("/sys/devices/platform/{,*/}*firmware*/get_throttled", GLOB_BRACE, NULL, &found) == 0) {
+        throttle_fd_ = open(found.gl_pathv[0], O_RDONLY | O_CLOEXEC);
+    }
+    globfree(&found);
+
+    if (empty()) {
+        printf("Thermal sampler: no cpufreq, thermal zone or throttle status on this host, off\n");
+        return;
+    }
+
+    size_t cpus = freq_fds_.size();
+    size_t per_sample = sizeof(uint64_t) + sizeof(int32_t) + sizeof(uint32_t) + cpus * sizeof(uint32_t);
+    bytes_ = THERMAL_SAMPLES * per_sample;
+    mem_ = AllocLocked(bytes_, "ThermalSampler");
+    ts_ = static_cast<uint64_t*>(mem_);
+    temp_mc_ = reinterpret_cast<int32_t*>(ts_ + THERMAL_SAMPLES);
+    throttled_ = reinterpret_cast<uint32_t*>(temp_mc_ + THERMAL_SAMPLES);
+    khz_ = throttled_ + THERMAL_SAMPLES;
+    if (trace) trace_.reset(new TraceRing(0, "thermal sampler"));
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : freq_cpus_) CPU_SET(cpu, &set);
+    printf("Thermal sampler: every %d ms, cpufreq on CPUs %s, thermal zone %s, throttle flags %s\n", interval_ms,
+           cpus ? FormatCpuList(set).c_str() : "none", temp_fd_ >= 0 ? zone_.c_str() : "none",
+           throttle_fd_ >= 0 ? "yes" : "no");
+}
+
+ThermalSampler::~ThermalSampler() {
+    Stop();
+    for (int fd : freq_fds_) close(fd);
+    if (temp_fd_ >= 0) close(temp_fd_);
+    if (throttle_fd_ >= 0) close(throttle_fd_);
+    if (mem_) FreeLocked(mem_, bytes_);
+}
+
+void ThermalSampler::Sample(size_t i) {
+    ts_[i] = TimingNowNs();
+    size_t cpus = freq_fds_.size();
+    for (size_t k = 0; k < cpus; k++) {
+        long khz;
+        khz_[i * cpus + k] = ReadValue(freq_fds_[k], &khz) ? (uint32_t)khz : 0;
+        if (trace_ && khz_[i * cpus + k]) trace_->RecordCounter(TRACE_CPU_FREQ, freq_cpus_[k], khz_[i * cpus + k]);
+    }
+    long mc;
+    temp_mc_[i] = temp_fd_ >= 0 && ReadValue(temp_fd_, &mc) ? (int32_t)mc : TEMP_UNKNOWN;
+    if (trace_ && temp_mc_[i] != TEMP_UNKNOWN) trace_->RecordCounter(TRACE_TEMPERATURE, 0, temp_mc_[i] > 0 ? temp_mc_[i] : 0);
+    long flags = 0;
+    throttled_[i] = throttle_fd_ >= 0 && ReadValue(throttle_fd_, &flags, 16) ? (uint32_t)flags : 0;
+    if (trace_ && throttle_fd_ >= 0) trace_->RecordCounter(TRACE_THROTTLED, 0, throttled_[i] & 0xffff);
+}
+
+void* ThermalSampler::SamplerMain(void* arg) {
+    ThermalSampler* self = static_cast<ThermalSampler*>(arg);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (;;) {
+        size_t i = self->count_.load(std::memory_order_relaxed);
+        if (i == THERMAL_SAMPLES) {
+            printf("Thermal sampler: buffer full after %d samples, stopped sampling\n", THERMAL_SAMPLES);
+            break;
+        }
+        self->Sample(i);
+        self->count_.store(i + 1, std::memory_order_release);
+
+        TimespecAddNs(&next, self->interval_ns_);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+        }
+        if (self->stopping_.load(std::memory_order_acquire)) break;
+    }
+    return NULL;
+}
+
+void ThermalSampler::Start(const cpu_set_t& cpus) {
+    if (empty() || started_) return;
+    // Plain SCHED_OTHER on the NRT cores, whatever the caller runs as
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    sched_param param;
+    param.sched_priority = 0;
+    pthread_attr_setschedparam(&attr, &param);
+    SetAttrAffinity(&attr, cpus);
+    stopping_.store(false);
+    start_ns_ = TimingNowNs();
+    int ret = pthread_create(&thread_, &attr, &ThermalSampler::SamplerMain, this);
+    pthread_attr_destroy(&attr);
+    if (ret) throw std::runtime_error{std::string("ThermalSampler pthread_create failed: ") + strerror(ret)};
+    started_ = true;
+}
+
+void ThermalSampler::Stop() {
+    if (!started_) return;
+    started_ = false;
+    stopping_.store(true, std::memory_order_release);
+    pthread_join(thread_, NULL);
+    PrintRange("Run", start_ns_, TimingNowNs(), NULL);
+}
+
+// Names of the get_throttled conditions set in `flags`
+static std::string ThrottleText(uint32_t flags) {
+    static const struct {
+        uint32_t bit;
+        const char* name;
+    } kBits[] = {{THROTTLED_UNDERVOLT, "under-voltage"},
+                 {THROTTLED_FREQ_CAPPED, "arm-freq-capped"},
+                 {THROTTLED_THROTTLED, "throttled"},
+                 {THROTTLED_SOFT_TEMP, "soft-temp-limit"}};
+    std::string text;
+    for (const auto& b : kBits) {
+        if (flags & b.bit) text += std::string(text.empty() ? "" : ", ") + b.name;
+    }
+    return text;
+}
+
+void ThermalSampler::PrintRange(const char* label, uint64_t start_ns, uint64_t stop_ns, const cpu_set_t* cpus) const {
+    size_t n = count_.load(std::memory_order_acquire);
+    if (n == 0) return;
+    // The sample in force at start_ns, then every one taken during the run
+    size_t first = std::upper_bound(ts_, ts_ + n, start_ns) - ts_;
+    if (first > 0) first--;
+    size_t last = std::upper_bound(ts_, ts_ + n, stop_ns) - ts_;
+    if (last <= first) last = first + 1;
+
+    size_t ncpu = freq_fds_.size();
+    uint32_t khz_min = UINT32_MAX, khz_max = 0;
+    int32_t mc_min = INT32_MAX, mc_max = INT32_MIN;
+    uint32_t flags = 0;
+    cpu_set_t used;
+    CPU_ZERO(&used);
+    for (size_t i = first; i < last; i++) {
+        for (size_t k = 0; k < ncpu; k++) {
+            uint32_t khz = khz_[i * ncpu + k];
+            if (khz == 0 || (cpus && !CPU_ISSET(freq_cpus_[k], cpus))) continue;
+            CPU_SET(freq_cpus_[k], &used);
+            khz_min = std::min(khz_min, khz);
+            khz_max = std::max(khz_max, khz);
+        }
+        if (temp_mc_[i] != TEMP_UNKNOWN) {
+            mc_min = std::min(mc_min, temp_mc_[i]);
+            mc_max = std::max(mc_max, temp_mc_[i]);
+        }
+        flags |= throttled_[i] & 0xffff;
+    }
+
+    std::string text = std::string(label) + " thermal (" + std::to_string(last - first) + " samples):";
+    char part[96];
+    if (khz_max > 0) {
+        if (khz_min == khz_max) {
+            snprintf(part, sizeof(part), " CPU %s %u MHz", FormatCpuList(used).c_str(), khz_max / 1000);
+        } else {
+            snprintf(part, sizeof(part), " CPU %s %u-%u MHz", FormatCpuList(used).c_str(), khz_min / 1000,
+                     khz_max / 1000);
+        }
+        text += part;
+    }
+    if (mc_max != INT32_MIN) {
+        snprintf(part, sizeof(part), "%s %.1f-%.1f C", khz_max > 0 ? "," : "", mc_min / 1000.0, mc_max / 1000.0);
+        text += part;
+    }
+    if (throttle_fd_ >= 0) text += flags ? ", " + ThrottleText(flags) : ", not throttled";
+    printf("%s\n", text.c_str());
+}
@@ -0,0 +1,96 @@
+/**
+ * CPU frequency and thermal sampler.
+ *
+ * Under sustained BusyCal or canny load the Pi 5 lowers its clock, first
+ * at the firmware's soft temperature limit and then when it throttles, so
+ * a slow app can be the clock rather than the scheduler. The sampler is a
+ * SCHED_OTHER thread on the NRT cores that reads, every thermal_ms:
+ *
+ *   - cpufreq scaling_cur_freq of every CPU that has one
+ *   - the SoC thermal zone (type cpu-thermal / soc / x86_pkg_temp, else
+ *     thermal_zone0)
+ *   - the Raspberry Pi firmware's get_throttled flags, when present
+ *
+ * into a preallocated, locked sample buffer, and into the event trace as
+ * counter tracks. After each app's runtime and latency report, Join()
+ * prints the frequency range of the app's CPUs, the temperature range and
+ * any throttling seen during its run; the run ends with the same line for
+ * the whole run. Hosts with none of the sources print one line and skip
+ * the sampler.
+ */
+#ifndef P3_THERMAL_H
+#define P3_THERMAL_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "p3_trace.h"
+
+#define THERMAL_SAMPLES 65536  // 1.8 h at the default 100 ms
+
+// get_throttled bits: the condition now (low half) or since boot (<< 16)
+#define THROTTLED_UNDERVOLT 0x1
+#define THROTTLED_FREQ_CAPPED 0x2
+#define THROTTLED_THROTTLED 0x4
+#define THROTTLED_SOFT_TEMP 0x8
+
+class ThermalSampler {
+   public:
+    // Finds the sources and allocates the samples; with `trace`, also a
+    // trace row. Construct before LockMemory().
+    ThermalSampler(int interval_ms, bool trace);
+    ~ThermalSampler();
+
+    ThermalSampler(const ThermalSampler&) = delete;
+    ThermalSampler& operator=(const ThermalSampler&) = delete;
+
+    bool empty() const { return freq_fds_.empty() && temp_fd_ < 0 && throttle_fd_ < 0; }
+
+    // Sample on a thread restricted to `cpus` until Stop(); Stop() prints
+    // the whole run's line. Throws std::runtime_error.
+    void Start(const cpu_set_t& cpus);
+    void Stop();
+
+    // "<label> thermal: ..." for the samples in [start_ns, stop_ns] (and the
+    // one before, the state at start); frequencies of `cpus` only, or of
+    // every sampled CPU if NULL. Safe while sampling.
+    void PrintRange(const char* label, uint64_t start_ns, uint64_t stop_ns, const cpu_set_t* cpus) const;
+
+   private:
+    static void* SamplerMain(void* arg);
+    void Sample(size_t i);
+
+    long interval_ns_;
+    std::vector<int> freq_cpus_;  // CPU of each freq_fds_ entry
+    std::vector<int> freq_fds_;   // scaling_cur_freq, kept open
+    int temp_fd_ = -1;
+    std::string zone_;
+    int throttle_fd_ = -1;
+
+    // Sample i: ts_[i], temp_mc_[i], throttled_[i], khz_[i * CPUs + k]
+    size_t bytes_ = 0;
+    void* mem_ = NULL;
+    uint64_t* ts_ = NULL;
+    int32_t* temp_mc_ = NULL;
+    uint32_t* throttled_ = NULL;
+    uint32_t* khz_ = NULL;
+    std::atomic<size_t> count_{0};
+
+    std::unique_ptr<TraceRing> trace_;
+    pthread_t thread_;
+    bool started_ = false;
+    std::atomic<bool> stopping_{false};
+    uint64_t start_ns_ = 0;
+};
+
+// The run's sampler while one is running (NULL otherwise); Join() reports
+// through it
+extern ThermalSampler* g_thermal_sampler;
+
+#endif
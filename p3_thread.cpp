@@ -0,0 +1,64 @@
+#include "p3_thread.h"
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <sys/mman.h>  // necessary for mlockall
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "p3_experiment.h"
+
+void LockMemory() {
+    int ret = mlockall(MCL_CURRENT | MCL_FUTURE);
+    if (ret) {
+        throw std::runtime_error{std::string("mlockall failed: ") + std::strerror(errno)};
+    }
+}
+
+void RtProcessInit(long heap_mb) {
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+
+    // Freed memory stays in the heap, and large blocks come from it too
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_TOP_PAD, 0);
+    mallopt(M_MMAP_MAX, 0);
+    mallopt(M_ARENA_MAX, 1);
+    LockMemory();
+
+    // Grow the heap once and touch every page; with trimming off, free()
+    // keeps it for later allocations, which then never fault
+    size_t bytes = (size_t)heap_mb << 20;
+    if (bytes) {
+        long page = sysconf(_SC_PAGESIZE);
+        volatile char* heap = static_cast<volatile char*>(malloc(bytes));
+        if (!heap) throw std::runtime_error{"RT heap reserve failed"};
+        for (size_t i = 0; i < bytes; i += page) heap[i] = 0;
+        free((void*)heap);
+    }
+
+    getrusage(RUSAGE_SELF, &after);
+    printf("RT init: memory locked, %ld MB heap reserved, malloc trim/mmap off (init faults: minor %ld, major %ld)\n",
+           heap_mb, after.ru_minflt - before.ru_minflt, after.ru_majflt - before.ru_majflt);
+}
+
+// noinline so the array really lives below the caller's frame
+__attribute__((noinline)) void PrefaultStack() {
+    volatile unsigned char stack[RT_STACK_PREFAULT];
+    for (size_t i = 0; i < sizeof(stack); i += 4096) stack[i] = 0;
+}
+
+void SetAttrAffinity(pthread_attr_t* attr, const cpu_set_t& cpus) {
+    int ret = pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t), &cpus);
+    if (ret) {
+        throw std::runtime_error{std::string("pthread_attr_setaffinity_np failed: ") + std::strerror(ret)};
+    }
+}
+
+void PrintCPU(const char* kind) {
+    cpu_set_t cpus;
+    pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+    printf("[%s thread #%lu] running on CPU #%d (allowed: %s)\n", kind, pthread_self(), sched_getcpu(),
+           FormatCpuList(cpus).c_str());
+}
+
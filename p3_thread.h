@@ -0,0 +1,475 @@
+/**
+ * RT and NRT thread classes shared by the experiment apps and the staged
+ * CannyP3 pipeline.
+ */
+#ifndef P3_THREAD_H
+#define P3_THREAD_H
+
+#include <pthread.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "p3_histogram.h"
+#include "p3_metrics.h"
+#include "p3_overrun.h"
+#include "p3_perf.h"
+#include "p3_sched.h"
+#include "p3_thermal.h"
+#include "p3_timing.h"
+#include "p3_trace.h"
+
+#define RT_STACK_SIZE (1024 * 1024)          // per RT thread
+#define RT_STACK_PREFAULT (RT_STACK_SIZE - 64 * 1024)  // leave room for the caller's frames
+#define RT_HEAP_RESERVE_MB 64
+
+void LockMemory();
+
+// Full RT process setup, run once before any app starts: malloc never
+// trims the heap or serves blocks from mmap (and uses a single arena, so
+// a thread's first malloc does not map a new one), all memory is locked,
+// and heap_mb of heap is reserved and touched up front. Prints the
+// page faults init took. Throws std::runtime_error if locking fails.
+void RtProcessInit(long heap_mb = RT_HEAP_RESERVE_MB);
+
+// Touch RT_STACK_PREFAULT bytes below the caller's frame, so the thread
+// never takes a stack fault later; call at thread entry
+void PrefaultStack();
+
+// Attach a CPU affinity mask to thread attributes, so the thread is created
+// on an allowed core instead of migrating there after it starts
+void SetAttrAffinity(pthread_attr_t* attr, const cpu_set_t& cpus);
+
+// "CPU #n (allowed: list)" for the thread banners
+void PrintCPU(const char* kind);
+
+class ThreadRT {
+    int priority_;
+    int policy_;
+    pthread_t thread_;
+    Stopwatch runtime_;
+    uint64_t cpu_ns_ = 0;
+    PerfCounters perf_;  // opened by the thread around its workload
+    std::unique_ptr<TraceRing> trace_;  // NULL unless EnableTrace()
+    MetricsSlot* metrics_ = NULL;       // NULL unless EnableMetrics()
+    bool pinned_ = false;
+    cpu_set_t cpus_;
+
+    // Clock and temperature over this thread's run (p3_thermal.h)
+    void PrintThermal() const {
+        if (!g_thermal_sampler) return;
+        std::string label = "App #" + std::to_string(app_id_);
+        g_thermal_sampler->PrintRange(label.c_str(), runtime_.start_ns(), runtime_.stop_ns(), pinned_ ? &cpus_ : NULL);
+    }
+
+    // Periodic mode (period_ns_ == 0 means a single call to Run())
+    long period_ns_ = 0;
+    long deadline_ns_ = 0;  // relative to each release
+    int max_cycles_ = 0;    // 0 means until Cycle() returns false
+    int cycles_ = 0;
+    long overruns_ = 0;
+
+    // Overload handling (p3_overrun.h)
+    OverrunPolicy overrun_policy_ = OVERRUN_LOG;
+    DeadlineMonitor deadlines_;
+    bool degraded_ = false;
+
+    // Wakeup latency per cycle; preallocated with the thread object
+    LatencyHistogram latency_;
+
+    // SCHED_DEADLINE reservation, applied by the thread itself at entry
+    DeadlineParams dl_;
+    int admission_error_ = 0;
+
+    void RunPeriodic() {
+        if (!Setup()) {
+            printf("[RT thread #%lu] App #%d setup failed\n", pthread_self(), app_id_);
+            return;
+        }
+
+        // The measured section is the cycle loop; Setup() may fault freely
+        perf_.Start();
+
+        // Releases are absolute CLOCK_MONOTONIC instants, so a late cycle
+        // does not shift the phase of the following ones
+        struct timespec release;
+        clock_gettime(CLOCK_MONOTONIC, &release);
+        int last_cpu = -1;
+        while (max_cycles_ == 0 || cycles_ < max_cycles_) {
+            TimespecAddNs(&release, period_ns_);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &release, NULL) == EINTR) {
+            }
+
+            // Wakeup latency: actual wake time minus intended release
+            struct timespec woke;
+            clock_gettime(CLOCK_MONOTONIC, &woke);
+            long wake_ns = TimespecDiffNs(woke, release);
+            latency_.Record(wake_ns);
+
+            // Traced runs also note migrations and preemptions per cycle
+            int cycle = cycles_;
+            struct rusage ru;
+            long nivcsw = 0;
+            if (Tracing()) {
+                int cpu = sched_getcpu();
+                if (last_cpu >= 0 && cpu != last_cpu) Trace(TRACE_MIGRATED, last_cpu);
+                last_cpu = cpu;
+                if (getrusage(RUSAGE_THREAD, &ru) == 0) nivcsw = ru.ru_nivcsw;
+                Trace(TRACE_CYCLE_BEGIN, cycle);
+            }
+
+            bool more = Cycle(cycles_++);
+
+            // Overrun: the cycle completed after its deadline
+            struct timespec done;
+            clock_gettime(CLOCK_MONOTONIC, &done);
+            if (Tracing()) {
+                Trace(TRACE_CYCLE_END, cycle);
+                if (getrusage(RUSAGE_THREAD, &ru) == 0 && ru.ru_nivcsw > nivcsw) {
+                    Trace(TRACE_PREEMPTED, (uint32_t)(ru.ru_nivcsw - nivcsw));
+                }
+            }
+            long late_ns = TimespecDiffNs(done, release) - deadline_ns_;
+            if (metrics_) metrics_->RecordCycle(wake_ns, late_ns > 0);
+            if (late_ns > 0) {
+                overruns_++;
+                Trace(TRACE_OVERRUN, cycle);
+                deadlines_.Missed(cycle, late_ns, degraded_);
+                OverrunPolicy action = OnDeadlineMiss(cycle, late_ns);
+                if (action == OVERRUN_SKIP) {
+                    // Drop the next release and any later ones already past
+                    long skipped = 0;
+                    do {
+                        TimespecAddNs(&release, period_ns_);
+                        skipped++;
+                    } while (TimespecDiffNs(done, release) >= period_ns_);
+                    deadlines_.Skipped(skipped);
+                    Trace(TRACE_SKIPPED, (uint32_t)skipped);
+                } else if (action == OVERRUN_DEGRADE && !degraded_) {
+                    degraded_ = true;
+                    Trace(TRACE_DEGRADED, 1);
+                    Degrade(true);
+                }
+            } else {
+                deadlines_.Met(degraded_);
+                if (degraded_ && deadlines_.on_time() >= DEGRADE_RECOVER_CYCLES) {
+                    degraded_ = false;
+                    Trace(TRACE_DEGRADED, 0);
+                    Degrade(false);
+                }
+            }
+            if (!more) break;
+        }
+        perf_.Stop();
+        Teardown();
+    }
+
+    static void* RunThreadRT(void* data) {
+        ThreadRT* thread = static_cast<ThreadRT*>(data);
+        PrefaultStack();
+
+        // SCHED_DEADLINE has no pthread attribute; switch ourselves over and
+        // skip the workload if admission control refuses the reservation
+        if (thread->policy_ == SCHED_DEADLINE) {
+            thread->admission_error_ = SetSelfDeadline(thread->dl_);
+            if (thread->admission_error_) {
+                printf("[RT thread #%lu] SCHED_DEADLINE admission failed: %s\n", pthread_self(),
+                       DeadlineErrorHint(thread->admission_error_));
+                return NULL;
+            }
+        }
+
+        // Print which CPU the RT thread is running on
+        PrintCPU("RT");
+    
+        // Get the thread's scheduling parameters (policy and priority);
+        // glibc caches the policy set at creation, so ask the kernel for DEADLINE
+        sched_param param;
+        int policy;
+        int ret = pthread_getschedparam(pthread_self(), &policy, &param);
+        DeadlineParams dl;
+        if (thread->policy_ == SCHED_DEADLINE && GetSelfDeadline(&dl) == 0) {
+            printf("[RT thread #%lu] Scheduling policy: SCHED_DEADLINE runtime %llu us, deadline %llu us, "
+                   "period %llu us\n",
+                   pthread_self(), (unsigned long long)dl.runtime_ns / 1000,
+                   (unsigned long long)dl.deadline_ns / 1000, (unsigned long long)dl.period_ns / 1000);
+        } else if (ret == 0) {
+            printf("[RT thread #%lu] Scheduling policy: ", pthread_self());
+            if (policy == SCHED_FIFO) {
+                printf("SCHED_FIFO ");
+            } else if (policy == SCHED_RR) {
+                printf("SCHED_RR ");
+            } else {
+                printf("Other policy ");
+            }
+            printf("with priority %d\n", param.sched_priority);
+        } else {
+            printf("[RT thread #%lu] Failed to get scheduling parameters\n", pthread_self());
+        }
+    
+        // Run the thread's workload
+        g_trace_self = thread->trace_.get();
+        MetricsBegin(thread->metrics_);
+        Trace(TRACE_THREAD_BEGIN);
+        if (thread->period_ns_ > 0) {
+            thread->RunPeriodic();
+        } else {
+            thread->perf_.Start();
+            thread->Run();
+            thread->perf_.Stop();
+        }
+        Trace(TRACE_THREAD_END);
+        MetricsEnd();
+        g_trace_self = NULL;
+        thread->cpu_ns_ = ThreadCpuNs();
+        return NULL;
+    }
+
+public:
+    int app_id_;
+
+    ThreadRT(int app_id, int priority, int policy) : priority_(priority), policy_(policy), app_id_(app_id) {}
+    virtual ~ThreadRT() {}
+
+    // Restrict the thread to a set of CPUs; applied through the thread
+    // attributes, so it never runs outside the mask
+    void SetAffinity(const cpu_set_t& cpus) {
+        cpus_ = cpus;
+        pinned_ = true;
+    }
+
+    // Record this thread's events for TraceDump(); call before Start()
+    void EnableTrace(const std::string& name) { trace_.reset(new TraceRing(app_id_, name)); }
+
+    // Export live counters in the metrics page (p3_metrics.h); call before Start()
+    void EnableMetrics(const char* cls, const std::string& workload) {
+        metrics_ = MetricsClaim(app_id_, cls, workload);
+    }
+
+    // Switch to periodic mode: Cycle() is released every period_us on an
+    // absolute CLOCK_MONOTONIC timeline and must finish within deadline_us
+    // (defaults to the period). cycles == 0 runs until Cycle() returns false.
+    void SetPeriodic(long period_us, long deadline_us = 0, int cycles = 0) {
+        period_ns_ = period_us * 1000L;
+        deadline_ns_ = (deadline_us > 0 ? deadline_us : period_us) * 1000L;
+        max_cycles_ = cycles;
+    }
+
+    // What the periodic loop does when a cycle misses its deadline
+    void SetOverrunPolicy(OverrunPolicy policy) { overrun_policy_ = policy; }
+
+    // SCHED_DEADLINE reservation (policy SCHED_DEADLINE only): runtime_us of
+    // CPU every period_us, finished within deadline_us (defaults to the period)
+    void SetDeadline(long runtime_us, long deadline_us, long period_us) {
+        dl_.runtime_ns = runtime_us * 1000ULL;
+        dl_.deadline_ns = (deadline_us > 0 ? deadline_us : period_us) * 1000ULL;
+        dl_.period_ns = period_us * 1000ULL;
+    }
+
+    // Non-zero errno if the SCHED_DEADLINE reservation was refused
+    int admission_error() const { return admission_error_; }
+
+    // Results, valid after Join()
+    double runtime_sec() const { return runtime_.elapsed_sec(); }
+    uint64_t cpu_ns() const { return cpu_ns_; }
+    bool periodic() const { return period_ns_ > 0; }
+    int cycles() const { return cycles_; }
+    long overruns() const { return overruns_; }
+    const LatencyHistogram& latency() const { return latency_; }
+
+    void Start() {
+        // Initialize pthread attributes
+        pthread_attr_t thread_attr;
+        pthread_attr_init(&thread_attr);
+
+        if (policy_ == SCHED_DEADLINE) {
+            // Start as SCHED_OTHER; the thread applies SCHED_DEADLINE itself
+            sched_param param;
+            param.sched_priority = 0;
+            pthread_attr_setschedpolicy(&thread_attr, SCHED_OTHER);
+            pthread_attr_setschedparam(&thread_attr, &param);
+        } else {
+            // Set the scheduling policy (e.g., SCHED_FIFO or SCHED_RR)
+            pthread_attr_setschedpolicy(&thread_attr, policy_);
+
+            // Set the thread's priority
+            sched_param param;
+            param.sched_priority = priority_;
+            pthread_attr_setschedparam(&thread_attr, &param);
+        }
+
+        // Set the thread's stack size (optional, but often necessary for RT threads)
+        pthread_attr_setstacksize(&thread_attr, RT_STACK_SIZE);  // 1MB stack size
+
+        // Ensure the thread does not inherit attributes from the parent thread
+        pthread_attr_setinheritsched(&thread_attr, PTHREAD_EXPLICIT_SCHED);
+
+        // Set the CPU affinity before creation
+        if (pinned_) {
+            SetAttrAffinity(&thread_attr, cpus_);
+        }
+
+        // Start the timer
+        runtime_.Start();
+
+        // Create the RT thread
+        int ret = pthread_create(&thread_, &thread_attr, &ThreadRT::RunThreadRT, this);
+        if (ret) {
+            throw std::runtime_error{std::string("pthread_create failed: ") + std::strerror(ret)};
+        }
+
+        // Destroy the thread attribute object after the thread has been created
+        pthread_attr_destroy(&thread_attr);
+    }
+
+    void Join() {
+        // Wait for the thread to finish
+        int ret = pthread_join(thread_, NULL);
+        if (ret) {
+            throw std::runtime_error{std::string("pthread_join failed: ") + std::strerror(ret)};
+        }
+
+        // End the timer and report elapsed and on-CPU time
+        runtime_.Stop();
+        if (admission_error_) {
+            printf("App #%d did not run: SCHED_DEADLINE admission failed (%s)\n", app_id_,
+                   std::strerror(admission_error_));
+            printf("[RT thread #%lu] App #%d Ends\n", thread_, app_id_);
+            return;
+        }
+        printf("App #%d runtime: %.9f seconds (on-CPU %.9f seconds)\n", app_id_, runtime_.elapsed_sec(),
+               cpu_ns_ * 1e-9);
+        perf_.Print(app_id_);
+        if (perf_.minor_faults() > 0 || perf_.major_faults() > 0) {
+            printf("App #%d WARNING: %ld minor / %ld major page faults in the measured section\n", app_id_,
+                   perf_.minor_faults(), perf_.major_faults());
+        }
+        if (period_ns_ > 0) {
+            printf("App #%d cycles: %d, overruns: %ld (period %ld us, deadline %ld us)\n", app_id_, cycles_,
+                   overruns_, period_ns_ / 1000, deadline_ns_ / 1000);
+            latency_.Print(app_id_);
+            deadlines_.Print(app_id_, overrun_policy_);
+        }
+        PrintThermal();
+
+        printf("[RT thread #%lu] App #%d Ends\n", thread_, app_id_);
+    }
+
+    virtual void Run() = 0;
+
+    // Periodic mode hooks: Setup() runs once before the first release,
+    // Cycle() once per period; returning false ends the loop; Teardown()
+    // runs once after the last cycle
+    virtual bool Setup() { return true; }
+    virtual void Teardown() {}
+    virtual bool Cycle(int /*cycle*/) {
+        Run();
+        return true;
+    }
+
+    // Overload hooks, periodic mode only: OnDeadlineMiss() picks the action
+    // for one miss (by default the SetOverrunPolicy() one); Degrade() moves
+    // the work to a cheaper mode and back
+    virtual OverrunPolicy OnDeadlineMiss(int /*cycle*/, long /*late_ns*/) { return overrun_policy_; }
+    virtual void Degrade(bool /*on*/) {}
+};
+
+class ThreadNRT {
+    pthread_t thread_;
+    Stopwatch runtime_;
+    uint64_t cpu_ns_ = 0;
+    PerfCounters perf_;  // opened by the thread around its workload
+    std::unique_ptr<TraceRing> trace_;  // NULL unless EnableTrace()
+    MetricsSlot* metrics_ = NULL;       // NULL unless EnableMetrics()
+    bool pinned_ = false;
+    cpu_set_t cpus_;
+
+    // Clock and temperature over this thread's run (p3_thermal.h)
+    void PrintThermal() const {
+        if (!g_thermal_sampler) return;
+        std::string label = "App #" + std::to_string(app_id_);
+        g_thermal_sampler->PrintRange(label.c_str(), runtime_.start_ns(), runtime_.stop_ns(), pinned_ ? &cpus_ : NULL);
+    }
+
+    static void* RunThreadNRT(void* data) {
+        ThreadNRT* thread = static_cast<ThreadNRT*>(data);
+        PrintCPU("NRT");
+        g_trace_self = thread->trace_.get();
+        MetricsBegin(thread->metrics_);
+        Trace(TRACE_THREAD_BEGIN);
+        thread->perf_.Start();
+        thread->Run();
+        thread->perf_.Stop();
+        Trace(TRACE_THREAD_END);
+        MetricsEnd();
+        g_trace_self = NULL;
+        thread->cpu_ns_ = ThreadCpuNs();
+        return NULL;
+    }
+
+public:
+    int app_id_;
+
+    ThreadNRT(int app_id) : app_id_(app_id) {}
+    virtual ~ThreadNRT() {}
+
+    // Results, valid after Join()
+    double runtime_sec() const { return runtime_.elapsed_sec(); }
+    uint64_t cpu_ns() const { return cpu_ns_; }
+
+    // Restrict the thread to a set of CPUs; applied through the thread
+    // attributes, so it never runs outside the mask
+    void SetAffinity(const cpu_set_t& cpus) {
+        cpus_ = cpus;
+        pinned_ = true;
+    }
+
+    // Record this thread's events for TraceDump(); call before Start()
+    void EnableTrace(const std::string& name) { trace_.reset(new TraceRing(app_id_, name)); }
+
+    // Export live counters in the metrics page (p3_metrics.h); call before Start()
+    void EnableMetrics(const char* cls, const std::string& workload) {
+        metrics_ = MetricsClaim(app_id_, cls, workload);
+    }
+
+    void Start() {
+        // Start the timer
+        runtime_.Start();
+
+        // Default (CFS) attributes, plus the CPU affinity if one is set
+        pthread_attr_t thread_attr;
+        pthread_attr_init(&thread_attr);
+        if (pinned_) {
+            SetAttrAffinity(&thread_attr, cpus_);
+        }
+
+        // Create the pthread
+        int ret = pthread_create(&thread_, &thread_attr, &ThreadNRT::RunThreadNRT, this);
+        if (ret) {
+            throw std::runtime_error{std::string("pthread_create failed: ") + std::strerror(ret)};
+        }
+        pthread_attr_destroy(&thread_attr);
+    }
+
+    void Join() {
+        // Wait for the thread to finish
+        pthread_join(thread_, NULL);
+
+        // End the timer and report elapsed and on-CPU time
+        runtime_.Stop();
+        printf("App #%d runtime: %.9f seconds (on-CPU %.9f seconds)\n", app_id_, runtime_.elapsed_sec(),
+               cpu_ns_ * 1e-9);
+        perf_.Print(app_id_);
+        PrintThermal();
+
+        printf("[NRT thread #%lu] App #%d Ends\n", thread_, app_id_);
+    }
+
+    virtual void Run() = 0;
+};
+
+#endif
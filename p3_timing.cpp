@@ -0,0 +1,64 @@
+#include "p3_timing.h"
+
+#if defined(P3_ARM_COUNTER) && !defined(__aarch64__)
+#error "P3_ARM_COUNTER requires an aarch64 target"
+#endif
+
+#if defined(P3_ARM_COUNTER)
+static inline uint64_t ReadCntvct() {
+    uint64_t ticks;
+    // isb keeps the counter read from being speculated ahead of earlier code
+    asm volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(ticks)::"memory");
+    return ticks;
+}
+
+static uint64_t CntFrequency() {
+    static const uint64_t freq = [] {
+        uint64_t f;
+        asm volatile("mrs %0, cntfrq_el0" : "=r"(f));
+        return f;
+    }();
+    return freq;
+}
+
+uint64_t TimingNowNs() {
+    uint64_t ticks = ReadCntvct();
+    uint64_t freq = CntFrequency();
+    // Split to avoid overflowing 64 bits for long uptimes
+    return (ticks / freq) * 1000000000ULL + (ticks % freq) * 1000000000ULL / freq;
+}
+
+const char* TimingBackend() { return "CNTVCT_EL0"; }
+#else
+uint64_t TimingNowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+const char* TimingBackend() { return "CLOCK_MONOTONIC_RAW"; }
+#endif
+
+uint64_t MonotonicNowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t ThreadCpuNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void TimespecAddNs(struct timespec* ts, long ns) {
+    ts->tv_nsec += ns;
+    while (ts->tv_nsec >= 1000000000L) {
+        ts->tv_nsec -= 1000000000L;
+        ts->tv_sec++;
+    }
+}
+
+long TimespecDiffNs(const struct timespec& a, const struct timespec& b) {
+    return (a.tv_sec - b.tv_sec) * 1000000000L + (a.tv_nsec - b.tv_nsec);
+}
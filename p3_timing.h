@@ -0,0 +1,46 @@
+/**
+ * Monotonic, high-resolution timing shared by the RT and NRT thread classes.
+ *
+ * Default backend is CLOCK_MONOTONIC_RAW (not slewed by NTP). Building with
+ * -DP3_ARM_COUNTER on aarch64 reads the generic timer CNTVCT_EL0 directly
+ * (54 MHz on the Pi 5), skipping the vDSO call.
+ */
+#ifndef P3_TIMING_H
+#define P3_TIMING_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Nanoseconds from an arbitrary, never-adjusted origin
+uint64_t TimingNowNs();
+
+// CLOCK_MONOTONIC nanoseconds, the clock V4L2 stamps frames with (unlike
+// TimingNowNs(), comparable with driver timestamps)
+uint64_t MonotonicNowNs();
+
+// On-CPU time consumed by the calling thread (CLOCK_THREAD_CPUTIME_ID)
+uint64_t ThreadCpuNs();
+
+// Name of the compiled-in backend, for run banners
+const char* TimingBackend();
+
+// timespec helpers for the CLOCK_MONOTONIC periodic timeline
+void TimespecAddNs(struct timespec* ts, long ns);
+long TimespecDiffNs(const struct timespec& a, const struct timespec& b);
+
+// Wall-clock span of a thread's lifetime, Start() to Stop()
+class Stopwatch {
+   public:
+    void Start() { start_ns_ = TimingNowNs(); }
+    void Stop() { stop_ns_ = TimingNowNs(); }
+    uint64_t elapsed_ns() const { return stop_ns_ - start_ns_; }
+    double elapsed_sec() const { return elapsed_ns() * 1e-9; }
+    uint64_t start_ns() const { return start_ns_; }
+    uint64_t stop_ns() const { return stop_ns_; }
+
+   private:
+    uint64_t start_ns_ = 0;
+    uint64_t stop_ns_ = 0;
+};
+
+#endif
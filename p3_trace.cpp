@@ -0,0 +1,109 @@
+#include "p3_trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "p3_framepool.h"
+
+thread_local TraceRing* g_trace_self = NULL;
+
+// Rings are created and destroyed on the main thread, but keep the
+// registry safe anyway; it is never touched from a traced hot path
+static std::mutex g_rings_mutex;
+static std::vector<TraceRing*> g_rings;
+
+TraceRing::TraceRing(int app_id, const std::string& name) : app_id_(app_id), name_(name) {
+    events_ = static_cast<TraceEvent*>(AllocLocked(TRACE_EVENTS * sizeof(TraceEvent), "TraceRing"));
+    std::lock_guard<std::mutex> lock(g_rings_mutex);
+    g_rings.push_back(this);
+}
+
+TraceRing::~TraceRing() {
+    {
+        std::lock_guard<std::mutex> lock(g_rings_mutex);
+        g_rings.erase(std::remove(g_rings.begin(), g_rings.end(), this), g_rings.end());
+    }
+    FreeLocked(events_, TRACE_EVENTS * sizeof(TraceEvent));
+}
+
+const TraceEvent& TraceRing::event(uint64_t i) const {
+    uint64_t head = recorded();
+    uint64_t first = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+    return events_[(first + i) & (TRACE_EVENTS - 1)];
+}
+
+// Chrome trace phases: B/E open and close a slice, i is an instant, C a
+// counter sample
+static const struct {
+    const char* name;
+    char phase;
+} kTraceIds[NUM_TRACE_IDS] = {
+    {"thread", 'B'}, {"thread", 'E'},    {"cycle", 'B'},    {"cycle", 'E'},     {"overrun", 'i'},
+    {"preempted", 'i'}, {"migrated", 'i'}, {"frame", 'B'}, {"frame", 'E'},     {"lock-wait", 'B'},
+    {"lock-wait", 'E'}, {"skipped", 'i'},  {"degraded", 'i'}, {"MHz", 'C'},    {"temperature", 'C'},
+    {"throttled", 'C'},
+};
+
+// Counter tracks of the thermal sampler: one clock track per CPU
+static void DumpCounter(FILE* out, const TraceEvent& e, double ts_us) {
+    if (e.id == TRACE_CPU_FREQ) {
+        fprintf(out, ",\n{\"name\":\"cpu%u MHz\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"MHz\":%.0f}}", e.cpu,
+                ts_us, e.arg / 1000.0);
+    } else if (e.id == TRACE_TEMPERATURE) {
+        fprintf(out, ",\n{\"name\":\"temperature\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"C\":%.1f}}", ts_us,
+                e.arg / 1000.0);
+    } else {
+        fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"flags\":%u}}",
+                kTraceIds[e.id].name, ts_us, e.arg);
+    }
+}
+
+bool TraceDump(const std::string& path) {
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) {
+        perror(path.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(g_rings_mutex);
+    // Timestamps relative to the earliest event, in microseconds
+    uint64_t origin = UINT64_MAX;
+    for (const TraceRing* ring : g_rings) {
+        if (ring->recorded()) origin = std::min(origin, ring->event(0).ts_ns);
+    }
+
+    fprintf(out, "{\"traceEvents\":[\n");
+    bool first = true;
+    uint64_t total = 0, lost = 0;
+    for (const TraceRing* ring : g_rings) {
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", ring->app_id(), ring->name().c_str());
+        first = false;
+
+        uint64_t n = std::min<uint64_t>(ring->recorded(), TRACE_EVENTS);
+        total += n;
+        lost += ring->recorded() - n;
+        for (uint64_t i = 0; i < n; i++) {
+            const TraceEvent& e = ring->event(i);
+            if (e.id >= NUM_TRACE_IDS) continue;
+            if (kTraceIds[e.id].phase == 'C') {
+                DumpCounter(out, e, (e.ts_ns - origin) / 1000.0);
+                continue;
+            }
+            fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d", kTraceIds[e.id].name,
+                    kTraceIds[e.id].phase, (e.ts_ns - origin) / 1000.0, ring->app_id());
+            if (kTraceIds[e.id].phase == 'i') fprintf(out, ",\"s\":\"t\"");
+            fprintf(out, ",\"args\":{\"cpu\":%u,\"arg\":%u}}", e.cpu, e.arg);
+        }
+    }
+    fprintf(out, "\n]}\n");
+    bool ok = fclose(out) == 0;
+    printf("Trace: %llu events from %zu threads in %s", (unsigned long long)total, g_rings.size(), path.c_str());
+    if (lost) printf(" (%llu oldest overwritten)", (unsigned long long)lost);
+    printf("\n");
+    return ok;
+}
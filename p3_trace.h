@@ -0,0 +1,109 @@
+/**
+ * Per-thread binary event trace, dumped after the run.
+ *
+ * Each traced thread owns a preallocated ring of fixed-size events
+ * (timestamp, event id, CPU, 32-bit argument). Only the owning thread
+ * writes it, so Record() is a handful of plain stores: no lock, no stdio,
+ * no allocation. When the ring is full the oldest events are overwritten.
+ * After every thread has been joined, TraceDump() writes all rings as one
+ * Chrome trace (JSON "traceEvents") that chrome://tracing and Perfetto
+ * open directly, with one timeline row per app.
+ *
+ * Code on a traced thread calls Trace(); on any other thread it is a no-op.
+ */
+#ifndef P3_TRACE_H
+#define P3_TRACE_H
+
+#include <sched.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include "p3_timing.h"
+
+#define TRACE_EVENTS 16384  // per thread (power of two), 16 bytes each
+
+enum TraceId : uint16_t {
+    TRACE_THREAD_BEGIN,
+    TRACE_THREAD_END,
+    TRACE_CYCLE_BEGIN,  // arg = cycle
+    TRACE_CYCLE_END,
+    TRACE_OVERRUN,      // arg = cycle
+    TRACE_PREEMPTED,    // arg = involuntary switches during the cycle
+    TRACE_MIGRATED,     // arg = previous CPU
+    TRACE_FRAME_BEGIN,  // arg = frame
+    TRACE_FRAME_END,
+    TRACE_LOCK_WAIT_BEGIN,  // blocked on a contended RtMutex (p3_sync.h)
+    TRACE_LOCK_WAIT_END,
+    TRACE_SKIPPED,   // arg = releases dropped after a miss (p3_overrun.h)
+    TRACE_DEGRADED,  // arg = 1 entering, 0 leaving degraded mode
+    TRACE_CPU_FREQ,      // counter, cpu = sampled CPU, arg = kHz (p3_thermal.h)
+    TRACE_TEMPERATURE,   // counter, arg = millidegrees C
+    TRACE_THROTTLED,     // counter, arg = get_throttled flags
+    NUM_TRACE_IDS
+};
+
+struct TraceEvent {
+    uint64_t ts_ns;  // TimingNowNs()
+    uint16_t id;
+    uint16_t cpu;
+    uint32_t arg;
+};
+
+class TraceRing {
+   public:
+    // Registers the ring for TraceDump(); construct before LockMemory()
+    TraceRing(int app_id, const std::string& name);
+    ~TraceRing();
+
+    TraceRing(const TraceRing&) = delete;
+    TraceRing& operator=(const TraceRing&) = delete;
+
+    // Owning thread only
+    void Record(TraceId id, uint32_t arg) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        TraceEvent& e = events_[head & (TRACE_EVENTS - 1)];
+        e.ts_ns = TimingNowNs();
+        e.id = id;
+        e.cpu = (uint16_t)sched_getcpu();
+        e.arg = arg;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // A sampled value: `index` goes where the CPU would (p3_thermal.h)
+    void RecordCounter(TraceId id, uint16_t index, uint32_t value) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        TraceEvent& e = events_[head & (TRACE_EVENTS - 1)];
+        e.ts_ns = TimingNowNs();
+        e.id = id;
+        e.cpu = index;
+        e.arg = value;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    int app_id() const { return app_id_; }
+    const std::string& name() const { return name_; }
+    uint64_t recorded() const { return head_.load(std::memory_order_acquire); }
+    // Oldest surviving event first; i < min(recorded(), TRACE_EVENTS)
+    const TraceEvent& event(uint64_t i) const;
+
+   private:
+    int app_id_;
+    std::string name_;
+    TraceEvent* events_;
+    std::atomic<uint64_t> head_{0};
+};
+
+// The calling thread's ring (NULL to detach); set by the thread classes
+extern thread_local TraceRing* g_trace_self;
+
+inline void Trace(TraceId id, uint32_t arg = 0) {
+    if (g_trace_self) g_trace_self->Record(id, arg);
+}
+inline bool Tracing() { return g_trace_self != NULL; }
+
+// Chrome trace JSON of every registered ring; false after printing why
+bool TraceDump(const std::string& path);
+
+#endif
@@ -1,68 +1,267 @@
 #include "p3_util.h"
 
-void BusyCal() {
-    long abc = 1e9;
-    while (abc--) {
-        long tmp = 10000 * 10000;
+#include <string.h>
+
+#include <mutex>
+#include <vector>
+
+#include "p3_metrics.h"
+
+// Closed streams of the run, for PrintStreamSummary()
+struct StreamReport {
+    int app_id, stream, frames;
+    uint64_t first_ns, last_ns;
+    double lat_avg_us, lat_p99_us, lat_max_us;
+};
+static std::mutex g_stream_mutex;
+static std::vector<StreamReport> g_stream_reports;
+
+bool CannyStream::Open() {
+    cnt_ = 0;
+    if (!options_.input_raw.empty()) {
+        // Pre-decoded frames: mapped and locked here, then plain loads
+        try {
+            raw_ = SharedRawFrames(options_.input_raw);
+        } catch (const std::exception& e) {
+            cout << e.what() << endl;
+            return false;
+        }
+        rows_ = raw_->rows();
+        cols_ = raw_->cols();
+        // Independent feeds: stream i of N starts i/N of the way into the clip
+        if (options_.stream > 0) first_frame_ = options_.stream * raw_->frames() / options_.streams;
+    } else if (!options_.camera.empty()) {
+        camera_.reset(new V4l2Capture());
+        if (!camera_->Open(options_.camera.c_str(), WIDTH, HEIGHT)) return false;
+        rows_ = camera_->height();  // what the driver negotiated
+        cols_ = camera_->width();
+        sensor_latency_.Reset();
+    } else if (!OpenVideo()) {
+        return false;
     }
-}
 
-void CannyP3() {
-    char outfilename[128];
-    unsigned char *image;
-    unsigned char *edge;
-    int rows, cols;
-    float sigma, tlow, thigh;
-    int cnt = 0;
+    // Open() runs on the app's own thread, where nothing would catch an
+    // exception: locked buffers, band helpers and the writer report here
+    try {
+        // Gray input and edge output live in a locked pool, and grayframe_ wraps
+        // its buffer, so cvtColor and canny reuse the same memory every frame
+        pool_.reset(new FramePool(2, rows_, cols_));
+        grayframe_ = Mat(rows_, cols_, CV_8UC1, pool_->frame(0));
 
-    sigma = 1;
-    tlow = 0.2;
-    thigh = 0.6;
-    rows = HEIGHT;
-    cols = WIDTH;
+        // Kernels for the size actually captured, picked once for the stream
+        bool fixed;
+        canny_ = CannySelect(options_.mode, rows_, cols_, &fixed);
+        degraded_canny_ = CannySelect(CANNY_INT, rows_, cols_);
+        printf("CannyP3: %dx%d input, %s %s kernels\n", cols_, rows_, fixed ? "fixed-size" : "generic",
+               CannyModeName(options_.mode));
 
-    VideoCapture cap;
+        // On the app's own thread, so band helpers pick up its policy and
+        // priority
+        tiled_.reset(CannyTiled::ForCaller(options_.tiling, rows_, cols_));
+
+        // Edge images leave the loop through the writer thread
+        char prefix[128];
+        sprintf(prefix, "camera_s_%3.2f_l_%3.2f_h_%3.2f", sigma_, tlow_, thigh_);
+        if (options_.stream >= 0) sprintf(prefix + strlen(prefix), "_stream%d", options_.stream);
+        frame_latency_.Reset();
+        writer_.reset(new EdgeWriter(options_.output, rows_, cols_, prefix));
+    } catch (const std::exception& e) {
+        cout << e.what() << endl;
+        tiled_.reset();
+        return false;
+    }
+    return true;
+}
+
+bool CannyStream::OpenVideo() {
+    VideoCapture& cap = cap_;
     // open the default camera (/dev/video0)
     // Check VideoCapture documentation for more details
     // if(!cap.open(0)){
     if (!cap.open("ground_crew_480p.mp4")) {
         cout << "Failed to open /dev/video0" << endl;
-        exit(0);
-        // return NULL;
+        return false;
     }
     cap.set(CAP_PROP_FRAME_WIDTH, WIDTH);
     cap.set(CAP_PROP_FRAME_HEIGHT, HEIGHT);
 
-    Mat frame, grayframe;
-    // test capture
-    cap >> frame;
+    // test capture; the decoder may not honor the requested size
+    cap >> frame_;
+    if (frame_.empty()) {
+        cout << "ground_crew_480p.mp4 has no frames" << endl;
+        return false;
+    }
+    rows_ = frame_.rows;
+    cols_ = frame_.cols;
+    return true;
+}
+
+bool CannyStream::ProcessFrame() {
+    unsigned char *image;
+    int rows = rows_, cols = cols_;
+
+    // Edges go straight into a writer slot; if the writer is behind, the
+    // frame is still computed (into the fallback frame) but not written
+    int slot = writer_->Acquire();
+    unsigned char *edge = slot >= 0 ? writer_->frame(slot) : pool_->frame(1);
+
+    Trace(TRACE_FRAME_BEGIN, cnt_);
+    uint64_t start_ns = TimingNowNs();
+    if (cnt_ == 0) first_ns_ = start_ns;
+    V4l2Frame shot;
+    if (camera_) {
+        // The Y plane of the driver buffer is the canny input
+        if (!camera_->Dequeue(&shot)) return false;
+        image = const_cast<unsigned char *>(shot.y);
+    } else if (raw_) {
+        image = const_cast<unsigned char *>(raw_->frame(first_frame_ + cnt_));
+    } else {
+        cap_ >> frame_;
+        if (frame_.empty()) {
+            cap_.set(CAP_PROP_POS_FRAMES, 0);
+            cap_ >> frame_;
+        }  // end of video stream, repeat
+        cvtColor(frame_, grayframe_, COLOR_BGR2GRAY);
+        image = grayframe_.data;
+    }
+    if (degraded_) {
+        if (tiled_) {
+            tiled_->Run(image, CANNY_DEGRADED_SIGMA, tlow_, thigh_, edge, pool_->scratch());
+        } else {
+            degraded_canny_(image, rows, cols, CANNY_DEGRADED_SIGMA, tlow_, thigh_, edge, pool_->scratch());
+        }
+        degraded_frames_++;
+    } else if (tiled_) {
+        tiled_->Run(image, sigma_, tlow_, thigh_, edge, pool_->scratch());
+    } else {
+        canny_(image, rows, cols, sigma_, tlow_, thigh_, edge, pool_->scratch());
+    }
+    if (camera_) {
+        if (shot.timestamp_ns) sensor_latency_.Record((long)(MonotonicNowNs() - shot.timestamp_ns));
+        camera_->Requeue(shot);
+    }
+#if IMSHOW_DISPLAY
+    Mat edgeframe(rows, cols, CV_8UC1, edge);
+    imshow("[EDGE] this is you, smile! :)", edgeframe);
+#endif
+    if (slot >= 0) {
+        writer_->Submit(slot, cnt_);
+    } else {
+        writer_->Drop();
+    }
+    last_ns_ = TimingNowNs();
+    if (options_.stream >= 0) frame_latency_.Record((long)(last_ns_ - start_ns));
+    Trace(TRACE_FRAME_END, cnt_);
+    MetricsFrame();
+    cnt_++;
+    if (!Tracing()) printf(">");  // the trace shows frames without stdio
+#if IMSHOW_DISPLAY
+    if (waitKey(10) == 27) return false;  // stop capturing by pressing ESC
+#endif
+
+    return cnt_ < MAX_FRAME_NUM;  // AUTO-OFF after 100 frames
+}
+
+void CannyStream::Close() {
+    if (writer_) writer_->Close();
+    if (degraded_frames_) printf("CannyP3: %d of %d frames degraded (sigma %.2f)\n", degraded_frames_, cnt_, CANNY_DEGRADED_SIGMA);
+    if (camera_) {
+        sensor_latency_.Print("Sensor-to-edge latency");
+        if (camera_->dropped()) printf("Camera dropped %u frames\n", camera_->dropped());
+    }
+    if (options_.stream >= 0 && cnt_ > 0) {
+        char label[64];
+        snprintf(label, sizeof(label), "App #%d stream %d frame latency", options_.app_id, options_.stream);
+        frame_latency_.Print(label);
+        std::lock_guard<std::mutex> lock(g_stream_mutex);
+        g_stream_reports.push_back({options_.app_id, options_.stream, cnt_, first_ns_, last_ns_,
+                                    frame_latency_.avg_us(), frame_latency_.Percentile(0.99),
+                                    frame_latency_.max_us()});
+    }
+}
+
+void PrintStreamSummary() {
+    std::lock_guard<std::mutex> lock(g_stream_mutex);
+    if (g_stream_reports.empty()) return;
+    uint64_t first = g_stream_reports[0].first_ns, last = g_stream_reports[0].last_ns;
+    long frames = 0;
+    double worst_p99 = 0;
+    for (const StreamReport& r : g_stream_reports) {
+        double sec = (r.last_ns - r.first_ns) * 1e-9;
+        printf("Stream %d (App #%d): %d frames, %.1f fps, frame latency avg %.1f us, p99 %.0f us, max %.1f us\n",
+               r.stream, r.app_id, r.frames, sec > 0 ? r.frames / sec : 0.0, r.lat_avg_us, r.lat_p99_us,
+               r.lat_max_us);
+        if (r.first_ns < first) first = r.first_ns;
+        if (r.last_ns > last) last = r.last_ns;
+        if (r.lat_p99_us > worst_p99) worst_p99 = r.lat_p99_us;
+        frames += r.frames;
+    }
+    double sec = (last - first) * 1e-9;
+    printf("Streams: %zu, %ld frames in %.3f s = %.1f fps total, worst stream p99 %.0f us\n", g_stream_reports.size(),
+           frames, sec, sec > 0 ? frames / sec : 0.0, worst_p99);
+    g_stream_reports.clear();
+}
+
+void CannyP3(const CannyOptions& options) {
+    CannyStream stream;
+    stream.SetOptions(options);
+    if (!stream.Open()) {
+        exit(0);
+    }
 
 #if IMSHOW_DISPLAY
     printf("[INFO] (On the pop-up window) Press ESC to terminate the program...\n");
 #endif
     printf("Writing the edge image in the file: ");
-    for (;;) {
+    while (stream.ProcessFrame()) {
+    }
+    printf("\n");
+    stream.Close();
+}
+
+bool DecodeToRaw(const char* path, int rows, int cols) {
+    VideoCapture cap;
+    if (!cap.open("ground_crew_480p.mp4")) {
+        cout << "Failed to open ground_crew_480p.mp4" << endl;
+        return false;
+    }
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        perror(path);
+        return false;
+    }
+
+    // Header first, padded to RAW_HEADER_BYTES, then the frames back to back
+    static char header[RAW_HEADER_BYTES];
+    FillRawHeader(reinterpret_cast<RawFrameHeader*>(header), rows, cols, MAX_FRAME_NUM);
+    bool ok = fwrite(header, 1, sizeof(header), out) == sizeof(header);
+
+    // Same frame sequence CannyP3 sees: the clip loops until MAX_FRAME_NUM
+    Mat frame, sized, gray;
+    for (int i = 0; ok && i < MAX_FRAME_NUM; i++) {
         cap >> frame;
         if (frame.empty()) {
             cap.set(CAP_PROP_POS_FRAMES, 0);
             cap >> frame;
-        }  // end of video stream, repeat
-        cvtColor(frame, grayframe, COLOR_BGR2GRAY);
-        image = grayframe.data;
-        canny(image, rows, cols, sigma, tlow, thigh, &edge, NULL);
-        sprintf(outfilename, "camera_s_%3.2f_l_%3.2f_h_%3.2f_%d.pgm", sigma, tlow, thigh, cnt++);
-        if (write_pgm_image(outfilename, edge, rows, cols, NULL, 255) == 0) {
-            fprintf(stderr, "Error writing the edge image, %s.\n", outfilename);
-            exit(1);
         }
-        printf(">");
-#if IMSHOW_DISPLAY
-        grayframe.data = edge;
-        imshow("[EDGE] this is you, smile! :)", grayframe);
-        if (waitKey(10) == 27) break;  // stop capturing by pressing ESC
-#endif
-
-        if (cnt >= MAX_FRAME_NUM) break;  // AUTO-OFF after 100 frames
+        if (frame.empty()) {
+            cout << "ground_crew_480p.mp4 has no frames" << endl;
+            ok = false;
+            break;
+        }
+        if (frame.cols != cols || frame.rows != rows) {
+            resize(frame, sized, Size(cols, rows));
+            cvtColor(sized, gray, COLOR_BGR2GRAY);
+        } else {
+            cvtColor(frame, gray, COLOR_BGR2GRAY);
+        }
+        ok = fwrite(gray.data, 1, (size_t)cols * rows, out) == (size_t)cols * rows;
     }
-    printf("\n");
+    if (fclose(out) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "Error writing %s\n", path);
+        return false;
+    }
+    printf("Decoded %d frames (%dx%d gray) into %s\n", MAX_FRAME_NUM, cols, rows, path);
+    return true;
 }
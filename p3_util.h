@@ -1,11 +1,24 @@
 /**
  */
+#ifndef P3_UTIL_H
+#define P3_UTIL_H
+
 #include <unistd.h>
 
 #include <iostream>
+#include <memory>
 
 #include "canny_util.h"
 #include "opencv2/opencv.hpp"
+#include "p3_busycal.h"
+#include "p3_canny_tiled.h"
+#include "p3_edgewriter.h"
+#include "p3_framepool.h"
+#include "p3_histogram.h"
+#include "p3_rawframes.h"
+#include "p3_timing.h"
+#include "p3_trace.h"
+#include "p3_v4l2.h"
 
 using namespace std;
 using namespace cv;
@@ -19,5 +32,69 @@ using namespace cv;
 #define IMSHOW_DISPLAY false
 #define MAX_FRAME_NUM 100
 
-void BusyCal();
-void CannyP3();
+// Per-app canny configuration, taken from the experiment's canny_*,
+// edge_*, input_raw and camera keys
+struct CannyOptions {
+    CannyMode mode = CANNY_FLOAT;
+    CannyTiling tiling;
+    EdgeOutput output;
+    std::string input_raw;  // empty = decode the clip with VideoCapture
+    std::string camera;     // V4L2 device; overrides the clip
+    int app_id = 0;         // for reports
+    int stream = -1;        // index in a multi-stream group (streams = N); -1 = single
+    int streams = 0;        // size of that group
+};
+
+void CannyP3(const CannyOptions& options = CannyOptions());
+
+// Decode the CannyP3 clip once into a raw grayscale file (MAX_FRAME_NUM
+// frames, scaled to rows x cols); returns false after printing why
+bool DecodeToRaw(const char* path, int rows = HEIGHT, int cols = WIDTH);
+
+// After every stream of the run has been closed: per-stream frames, fps and
+// frame latency, then the total throughput over the streams' common wall
+// time. Prints nothing without streams.
+void PrintStreamSummary();
+
+// CannyP3 as a frame-at-a-time stream, so a periodic RT thread can process
+// exactly one frame per release. Streams of a group start at evenly spaced
+// frames of the shared clip, write edges under their own prefix and report
+// per-frame latency; Close() adds them to the group summary.
+#define CANNY_DEGRADED_SIGMA 0.6f
+
+class CannyStream {
+   public:
+    bool Open();
+    bool ProcessFrame();  // returns false once MAX_FRAME_NUM frames are written
+    void Close();         // flushes queued edge images
+    int frames() const { return cnt_; }
+    void SetOptions(const CannyOptions& options) { options_ = options; }
+    // Overload mode: CANNY_DEGRADED_SIGMA (a 5-tap instead of 7-tap
+    // Gaussian) and, unless banded, the integer path
+    void SetDegraded(bool degraded) { degraded_ = degraded; }
+
+   private:
+    bool OpenVideo();
+
+    VideoCapture cap_;
+    Mat frame_, grayframe_;
+    std::unique_ptr<FramePool> pool_;  // gray frame, fallback edge frame, canny scratch
+    float sigma_ = 1, tlow_ = 0.2, thigh_ = 0.6;
+    CannyOptions options_;
+    int rows_ = HEIGHT, cols_ = WIDTH;  // of the input actually opened
+    CannyFn canny_ = NULL;              // CannySelect() for rows_ x cols_
+    CannyFn degraded_canny_ = NULL;     // integer mode, same size
+    std::shared_ptr<const RawFrameSource> raw_;  // replaces cap_ when input_raw is set (SharedRawFrames)
+    int first_frame_ = 0;                        // this stream's offset into raw_
+    std::unique_ptr<V4l2Capture> camera_;  // replaces cap_ when camera is set
+    LatencyHistogram sensor_latency_{10};  // driver timestamp -> edges done, 10us buckets
+    LatencyHistogram frame_latency_{100};  // frame start -> edges submitted, 100us buckets (streams only)
+    uint64_t first_ns_ = 0, last_ns_ = 0;  // first frame start, last frame end
+    std::unique_ptr<CannyTiled> tiled_;    // band team, created in Open()
+    std::unique_ptr<EdgeWriter> writer_;   // edge slots + writer thread
+    int cnt_ = 0;
+    bool degraded_ = false;
+    int degraded_frames_ = 0;
+};
+
+#endif
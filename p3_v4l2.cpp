@@ -0,0 +1,215 @@
+#include "p3_v4l2.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "p3_canny.h"
+#include "p3_framepool.h"
+
+static int Xioctl(int fd, unsigned long request, void* arg) {
+    int ret;
+    do {
+        ret = ioctl(fd, request, arg);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+// Formats whose first plane is luma, best first; YUYV is the usual USB
+// webcam fallback and needs a deinterleaving copy
+static const struct {
+    uint32_t fourcc;
+    const char* name;
+} kFormats[] = {
+    {V4L2_PIX_FMT_GREY, "GREY"},
+    {V4L2_PIX_FMT_NV12, "NV12"},
+    {V4L2_PIX_FMT_YUV420, "YUV420"},
+    {V4L2_PIX_FMT_YUYV, "YUYV"},
+};
+
+V4l2Capture::~V4l2Capture() {
+    if (streaming_) {
+        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        Xioctl(fd_, VIDIOC_STREAMOFF, &type);
+    }
+    for (int i = 0; i < num_buffers_; i++) munmap(buffers_[i].start, buffers_[i].length);
+    if (gray_) FreeLocked(gray_, (size_t)width_ * height_);
+    if (fd_ >= 0) close(fd_);
+}
+
+bool V4l2Capture::Open(const char* device, int width, int height, int buffers) {
+    fd_ = open(device, O_RDWR);
+    if (fd_ < 0) {
+        printf("Failed to open %s: %s\n", device, strerror(errno));
+        return false;
+    }
+
+    v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (Xioctl(fd_, VIDIOC_QUERYCAP, &cap)) {
+        printf("%s: not a V4L2 device: %s\n", device, strerror(errno));
+        return false;
+    }
+    uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING)) {
+        printf("%s: no streaming video capture\n", device);
+        return false;
+    }
+
+    // Sizes to try, best first: the requested one, then the sizes with
+    // fixed-size canny kernels. S_FMT adjusts what it cannot do, so check
+    // what came back; if no format matches any of them exactly, take the
+    // size the driver negotiated for the requested one
+    struct Size {
+        int width, height;
+    };
+    std::vector<Size> sizes = {{width, height}};
+#define V4L2_TRY_SIZE(R, C) \
+    if (C != width || R != height) sizes.push_back({C, R});
+    CANNY_FIXED_SIZES(V4L2_TRY_SIZE)
+#undef V4L2_TRY_SIZE
+
+    v4l2_format fmt;
+    for (int pass = 0; pass < 2 && !pixfmt_; pass++) {
+        for (size_t s = 0; s < (pass == 0 ? sizes.size() : 1) && !pixfmt_; s++) {
+            for (const auto& f : kFormats) {
+                memset(&fmt, 0, sizeof(fmt));
+                fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                fmt.fmt.pix.width = sizes[s].width;
+                fmt.fmt.pix.height = sizes[s].height;
+                fmt.fmt.pix.pixelformat = f.fourcc;
+                fmt.fmt.pix.field = V4L2_FIELD_NONE;
+                if (Xioctl(fd_, VIDIOC_S_FMT, &fmt) != 0 || fmt.fmt.pix.pixelformat != f.fourcc) continue;
+                bool exact = (int)fmt.fmt.pix.width == sizes[s].width && (int)fmt.fmt.pix.height == sizes[s].height;
+                if ((exact || pass == 1) && fmt.fmt.pix.width >= 3 && fmt.fmt.pix.height >= 3) {
+                    pixfmt_ = f.fourcc;
+                    format_name_ = f.name;
+                    break;
+                }
+            }
+        }
+    }
+    if (!pixfmt_) {
+        printf("%s: no GREY/NV12/YUV420/YUYV format near %dx%d\n", device, width, height);
+        return false;
+    }
+    width_ = (int)fmt.fmt.pix.width;
+    height_ = (int)fmt.fmt.pix.height;
+    if (width_ != width || height_ != height) {
+        printf("%s: %dx%d not offered, capturing %s at %dx%d\n", device, width, height, format_name_, width_, height_);
+    }
+    bytesperline_ = fmt.fmt.pix.bytesperline;
+    if (bytesperline_ == 0) bytesperline_ = pixfmt_ == V4L2_PIX_FMT_YUYV ? 2 * width_ : width_;
+    zero_copy_ = pixfmt_ != V4L2_PIX_FMT_YUYV && bytesperline_ == width_;
+
+    v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = buffers < V4L2_MAX_BUFFERS ? buffers : V4L2_MAX_BUFFERS;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (Xioctl(fd_, VIDIOC_REQBUFS, &req) || req.count < 2) {
+        printf("%s: VIDIOC_REQBUFS failed: %s\n", device, strerror(errno));
+        return false;
+    }
+
+    for (unsigned i = 0; i < req.count && i < V4L2_MAX_BUFFERS; i++) {
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (Xioctl(fd_, VIDIOC_QUERYBUF, &buf)) {
+            printf("%s: VIDIOC_QUERYBUF failed: %s\n", device, strerror(errno));
+            return false;
+        }
+        void* start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, buf.m.offset);
+        if (start == MAP_FAILED) {
+            printf("%s: mmap of buffer %u failed: %s\n", device, i, strerror(errno));
+            return false;
+        }
+        buffers_[i].start = start;
+        buffers_[i].length = buf.length;
+        num_buffers_++;
+    }
+
+    if (!zero_copy_) {
+        try {
+            gray_ = static_cast<unsigned char*>(AllocLocked((size_t)width_ * height_, "V4l2Capture"));
+        } catch (const std::exception& e) {
+            printf("%s\n", e.what());
+            return false;
+        }
+    }
+
+    for (int i = 0; i < num_buffers_; i++) {
+        V4l2Frame frame = {i, NULL, 0, 0};
+        Requeue(frame);
+    }
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (Xioctl(fd_, VIDIOC_STREAMON, &type)) {
+        printf("%s: VIDIOC_STREAMON failed: %s\n", device, strerror(errno));
+        return false;
+    }
+    streaming_ = true;
+    printf("Camera %s: %dx%d %s, %d buffers%s\n", device, width_, height_, format_name_, num_buffers_,
+           zero_copy_ ? ", zero-copy Y plane" : ", Y plane copied");
+    return true;
+}
+
+bool V4l2Capture::Dequeue(V4l2Frame* frame) {
+    v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if (Xioctl(fd_, VIDIOC_DQBUF, &buf)) {
+        printf("VIDIOC_DQBUF failed: %s\n", strerror(errno));
+        return false;
+    }
+
+    frame->index = buf.index;
+    frame->sequence = buf.sequence;
+    frame->timestamp_ns = 0;
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        frame->timestamp_ns = (uint64_t)buf.timestamp.tv_sec * 1000000000ULL + buf.timestamp.tv_usec * 1000ULL;
+    }
+    if (have_seq_ && buf.sequence > last_seq_ + 1) dropped_ += buf.sequence - last_seq_ - 1;
+    have_seq_ = true;
+    last_seq_ = buf.sequence;
+
+    const unsigned char* base = static_cast<const unsigned char*>(buffers_[buf.index].start);
+    if (zero_copy_) {
+        frame->y = base;
+    } else if (pixfmt_ == V4L2_PIX_FMT_YUYV) {
+        // Y0 U Y1 V: luma is every other byte
+        for (int r = 0; r < height_; r++) {
+            const unsigned char* src = base + (size_t)r * bytesperline_;
+            unsigned char* dst = gray_ + (size_t)r * width_;
+            for (int c = 0; c < width_; c++) dst[c] = src[2 * c];
+        }
+        frame->y = gray_;
+    } else {
+        // Padded rows: drop the stride
+        for (int r = 0; r < height_; r++) {
+            memcpy(gray_ + (size_t)r * width_, base + (size_t)r * bytesperline_, width_);
+        }
+        frame->y = gray_;
+    }
+    return true;
+}
+
+void V4l2Capture::Requeue(const V4l2Frame& frame) {
+    v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = frame.index;
+    if (Xioctl(fd_, VIDIOC_QBUF, &buf)) printf("VIDIOC_QBUF failed: %s\n", strerror(errno));
+}
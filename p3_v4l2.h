@@ -0,0 +1,78 @@
+/**
+ * V4L2 camera capture with driver-owned, memory-mapped buffers.
+ *
+ * Buffers are requested with VIDIOC_REQBUFS (V4L2_MEMORY_MMAP), mapped once
+ * and cycled with QBUF/DQBUF. The format is negotiated so the first plane
+ * is the luma image (GREY, NV12 or YUV420): when the driver's row stride
+ * equals the width, the canny input is the driver buffer itself, with no
+ * decode and no cvtColor. Other layouts (YUYV, padded rows) get one
+ * Y-plane copy into a locked frame.
+ *
+ * Frames carry the driver's CLOCK_MONOTONIC capture timestamp, so callers
+ * can measure sensor-to-edge latency against MonotonicNowNs().
+ */
+#ifndef P3_V4L2_H
+#define P3_V4L2_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define V4L2_CAPTURE_BUFFERS 4  // driver buffers requested
+#define V4L2_MAX_BUFFERS 16
+
+struct V4l2Frame {
+    int index;                 // driver buffer, for Requeue()
+    const unsigned char* y;    // rows x cols luma, contiguous
+    uint64_t timestamp_ns;     // CLOCK_MONOTONIC; 0 if the driver has none
+    uint32_t sequence;
+};
+
+class V4l2Capture {
+   public:
+    V4l2Capture() {}
+    ~V4l2Capture();
+
+    V4l2Capture(const V4l2Capture&) = delete;
+    V4l2Capture& operator=(const V4l2Capture&) = delete;
+
+    // Negotiates width x height, or else the first CANNY_FIXED_SIZES size the
+    // driver offers, or else the size it adjusts width x height to (see
+    // width()/height()); maps the buffers and starts streaming. Returns
+    // false after printing why.
+    bool Open(const char* device, int width, int height, int buffers = V4L2_CAPTURE_BUFFERS);
+
+    // Blocks for the next filled buffer. The frame stays valid until it is
+    // handed back with Requeue().
+    bool Dequeue(V4l2Frame* frame);
+    void Requeue(const V4l2Frame& frame);
+
+    int width() const { return width_; }  // negotiated, valid after Open()
+    int height() const { return height_; }
+    bool zero_copy() const { return zero_copy_; }
+    const char* format_name() const { return format_name_; }
+    uint32_t dropped() const { return dropped_; }  // sequence gaps seen
+
+   private:
+    struct Buffer {
+        void* start;
+        size_t length;
+    };
+
+    int fd_ = -1;
+    Buffer buffers_[V4L2_MAX_BUFFERS];
+    int num_buffers_ = 0;
+    bool streaming_ = false;
+
+    int width_ = 0, height_ = 0;
+    uint32_t pixfmt_ = 0;
+    const char* format_name_ = "none";
+    int bytesperline_ = 0;
+    bool zero_copy_ = false;
+    unsigned char* gray_ = NULL;  // Y-plane copy when not zero-copy
+
+    bool have_seq_ = false;
+    uint32_t last_seq_ = 0;
+    uint32_t dropped_ = 0;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include "p3_workerpool.h"
+
+#include <limits.h>
+#include <stdio.h>
+
+#include "p3_thread.h"
+#include "p3_timing.h"
+
+class PoolWorker : public ThreadRT {
+   public:
+    PoolWorker(RtWorkerPool* pool, int index, int app_id, int priority, int policy)
+        : ThreadRT(app_id, priority, policy), pool_(pool), index_(index) {}
+
+    void Run() { pool_->WorkerLoop(index_); }
+
+   private:
+    RtWorkerPool* pool_;
+    int index_;
+};
+
+RtWorkerPool::RtWorkerPool(int first_app_id, int workers, int policy, int priority, const cpu_set_t* cpus) {
+    int cpu = -1;
+    for (int i = 0; i < workers; i++) {
+        workers_.emplace_back(new PoolWorker(this, i, first_app_id + i, priority, policy));
+        stats_.emplace_back(new WorkerStats());
+        if (cpus) {
+            // Next CPU of the set, wrapping around
+            do {
+                cpu = (cpu + 1) % CPU_SETSIZE;
+            } while (!CPU_ISSET(cpu, cpus));
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            workers_.back()->SetAffinity(one);
+        }
+    }
+}
+
+RtWorkerPool::~RtWorkerPool() { Close(); }
+
+void RtWorkerPool::Start() {
+    for (auto& worker : workers_) worker->Start();
+    started_ = true;
+}
+
+bool RtWorkerPool::Submit(void (*fn)(void* arg), void* arg) {
+    // Counted first, so a concurrent Wait() can never see zero early
+    outstanding_.fetch_add(1, std::memory_order_relaxed);
+    if (!queue_.Push({fn, arg, TimingNowNs()})) {
+        outstanding_.fetch_sub(1, std::memory_order_relaxed);
+        rejected_++;
+        return false;
+    }
+    // Pairs with the sleeper's increment: either it sees the job or we see it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) > 0) {
+        signal_.fetch_add(1, std::memory_order_release);
+        FutexWake(&signal_, 1);
+    }
+    return true;
+}
+
+void RtWorkerPool::Wait() {
+    for (;;) {
+        uint32_t left = outstanding_.load(std::memory_order_acquire);
+        if (left == 0) return;
+        FutexWait(&outstanding_, left);
+    }
+}
+
+void RtWorkerPool::WorkerLoop(int index) {
+    WorkerStats& stats = *stats_[index];
+    RtJob job;
+    for (;;) {
+        if (queue_.Pop(&job)) {
+            stats.dispatch.Record((long)(TimingNowNs() - job.submit_ns));
+            job.fn(job.arg);
+            stats.jobs++;
+            if (outstanding_.fetch_sub(1, std::memory_order_acq_rel) == 1) FutexWake(&outstanding_, INT_MAX);
+            continue;
+        }
+
+        // Announce the sleep, then look once more before blocking
+        uint32_t seen = signal_.load(std::memory_order_acquire);
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        if (!queue_.empty()) {
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (stopping_.load(std::memory_order_acquire)) {
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+        FutexWait(&signal_, seen);
+        stats.wakeups++;
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void RtWorkerPool::Close() {
+    if (!started_) return;
+    started_ = false;
+    stopping_.store(true, std::memory_order_release);
+    signal_.fetch_add(1, std::memory_order_release);
+    FutexWake(&signal_, INT_MAX);
+    for (auto& worker : workers_) worker->Join();
+
+    for (size_t i = 0; i < workers_.size(); i++) {
+        const WorkerStats& s = *stats_[i];
+        char label[64];
+        snprintf(label, sizeof(label), "Pool worker App #%d dispatch", workers_[i]->app_id_);
+        printf("Pool worker App #%d: %ld jobs, %ld futex wakeups\n", workers_[i]->app_id_, s.jobs, s.wakeups);
+        s.dispatch.Print(label);
+    }
+    if (rejected_) printf("Worker pool: %ld jobs rejected (queue full)\n", rejected_);
+}
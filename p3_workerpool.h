@@ -0,0 +1,90 @@
+/**
+ * Persistent RT worker pool for short, repeated jobs.
+ *
+ * Each worker is a ThreadRT created once, at Start(), with the pool's
+ * policy and priority and (optionally) pinned to one CPU of the pool's set,
+ * round robin. Its stack is prefaulted at thread entry like every RT
+ * thread's, so jobs pay neither pthread_create() nor first-touch faults.
+ *
+ * Jobs are a function pointer plus argument (no allocation per job) and go
+ * through a lock-free MPMC ring. Idle workers sleep on a futex and are
+ * woken one per submitted job; Wait() blocks the submitter on a second
+ * futex until every job so far has finished. Submit() and Wait() belong to
+ * one submitting thread (the owning app). Per worker, the pool reports
+ * jobs run, futex wakeups and the submit-to-start dispatch latency.
+ */
+#ifndef P3_WORKERPOOL_H
+#define P3_WORKERPOOL_H
+
+#include <sched.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "p3_histogram.h"
+#include "p3_ring.h"
+
+#define RTPOOL_QUEUE 256  // pending jobs (power of two)
+
+// As configured by pool_workers / pool_jobs / pool_cpus
+struct WorkerPoolSpec {
+    int workers = 2;
+    int jobs = 8;  // per Step of the pool-jobs workload
+    bool pinned = false;
+    cpu_set_t cpus;
+};
+
+struct RtJob {
+    void (*fn)(void* arg);
+    void* arg;
+    uint64_t submit_ns;
+};
+
+class PoolWorker;
+
+class RtWorkerPool {
+   public:
+    // Workers are App #first_app_id, #first_app_id + 1, ...; cpus == NULL
+    // leaves them unpinned. Construct before LockMemory()
+    RtWorkerPool(int first_app_id, int workers, int policy, int priority, const cpu_set_t* cpus);
+    ~RtWorkerPool();
+
+    RtWorkerPool(const RtWorkerPool&) = delete;
+    RtWorkerPool& operator=(const RtWorkerPool&) = delete;
+
+    void Start();
+
+    // False if the queue is full (the job is not run)
+    bool Submit(void (*fn)(void* arg), void* arg);
+    // Until every job submitted so far has finished
+    void Wait();
+
+    // Finish queued jobs, join the workers and print their statistics
+    void Close();
+
+    int workers() const { return (int)workers_.size(); }
+
+   private:
+    friend class PoolWorker;
+    void WorkerLoop(int index);
+
+    struct WorkerStats {
+        long jobs = 0;
+        long wakeups = 0;
+        LatencyHistogram dispatch;  // submit -> start, 1us buckets
+    };
+
+    MpmcRing<RtJob, RTPOOL_QUEUE> queue_;
+    alignas(64) std::atomic<uint32_t> signal_{0};       // futex: bumped to wake idle workers
+    alignas(64) std::atomic<uint32_t> outstanding_{0};  // futex: submitted, not yet finished
+    std::atomic<int> sleepers_{0};
+    std::atomic<bool> stopping_{false};
+    long rejected_ = 0;  // Submit() on a full queue; submitter only
+    std::vector<std::unique_ptr<PoolWorker>> workers_;
+    std::vector<std::unique_ptr<WorkerStats>> stats_;
+    bool started_ = false;
+};
+
+#endif
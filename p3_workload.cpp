@@ -0,0 +1,511 @@
+#include "p3_workload.h"
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "p3_framepool.h"
+#include "p3_metrics.h"
+#include "p3_rawframes.h"
+#include "p3_steal.h"
+#include "p3_timing.h"
+#include "p3_util.h"
+#include "p3_workerpool.h"
+
+// Results land here so the compiler cannot drop the loops
+static volatile uint64_t g_workload_sink;
+
+// Calibrated in the constructor, i.e. on the main thread before any app
+// starts competing for the CPU
+class BusyCalWorkload : public Workload {
+   public:
+    explicit BusyCalWorkload(const ThreadSpec& t) : work_(t.busy) {
+        printf("App #%d busycal: %s, %ld us per unit (%.3f chunks/us)\n", t.app_id, BusyFlavorName(t.busy.flavor),
+               t.busy.work_us, work_.chunks_per_us());
+    }
+    bool Step() {
+        work_.Run();
+        return true;
+    }
+
+   private:
+    BusyWork work_;
+};
+
+// A critical section on a resource other apps contend for: each unit takes
+// the shared mutex, runs one BusyWork unit while holding it, and releases
+// it. Blocking time lands in a histogram with 10us buckets (0..100ms),
+// enough to show an unbounded inversion next to a bounded one.
+class SharedLockWorkload : public Workload {
+   public:
+    explicit SharedLockWorkload(const ThreadSpec& t)
+        : app_id_(t.app_id),
+          mutex_(SharedMutex(t.lock, t.lock_protocol, t.lock_ceiling)),
+          lock_(t.lock),
+          work_(t.busy),
+          blocked_(10) {
+        printf("App #%d shared-lock: '%s' (%s), %ld us held per unit\n", t.app_id, t.lock.c_str(),
+               MutexProtocolName(t.lock_protocol), t.busy.work_us);
+    }
+    bool Step() {
+        long waited = mutex_->Lock();
+        if (waited < 0) {
+            errors_++;
+            return false;  // e.g. a ceiling below the caller's priority
+        }
+        work_.Run();
+        mutex_->Unlock();
+        blocked_.Record(waited);
+        if (waited > 0) contended_++;
+        return true;
+    }
+    void Teardown() {
+        char label[96];
+        snprintf(label, sizeof(label), "App #%d blocked on '%s' (%s)", app_id_, lock_.c_str(),
+                 MutexProtocolName(mutex_->protocol()));
+        blocked_.Print(label);
+        printf("App #%d lock: %ld of %llu acquisitions contended, %d errors\n", app_id_, contended_,
+               (unsigned long long)blocked_.count(), errors_);
+    }
+
+   private:
+    int app_id_;
+    RtMutex* mutex_;
+    std::string lock_;
+    BusyWork work_;
+    LatencyHistogram blocked_;
+    long contended_ = 0;
+    int errors_ = 0;
+};
+
+// Short RT jobs, dispatched to persistent workers instead of a thread each.
+// Workers are App #100*N+1.. of app N, one policy level with the app: FIFO
+// or RR at its priority (FIFO 1 under SCHED_DEADLINE, or for an NRT app
+// FIFO at `priority`).
+class PoolJobsWorkload : public Workload {
+   public:
+    explicit PoolJobsWorkload(const ThreadSpec& t)
+        : pool_(100 * t.app_id + 1, t.pool.workers, WorkerPolicy(t), t.policy == SCHED_DEADLINE ? 1 : t.priority,
+                t.pool.pinned ? &t.pool.cpus : NULL),
+          jobs_(t.pool.jobs, BusyWork(t.busy)) {
+        printf("App #%d pool-jobs: %d workers, %d x %ld us jobs per unit\n", t.app_id, t.pool.workers, t.pool.jobs,
+               t.busy.work_us);
+    }
+    bool Setup() {
+        pool_.Start();
+        return true;
+    }
+    bool Step() {
+        for (BusyWork& job : jobs_) {
+            if (!pool_.Submit(RunJob, &job)) job.Run();  // queue full: run it here
+        }
+        pool_.Wait();
+        return true;
+    }
+    void Teardown() { pool_.Close(); }
+
+   private:
+    static int WorkerPolicy(const ThreadSpec& t) {
+        return t.cls == THREAD_RT && t.policy != SCHED_DEADLINE ? t.policy : SCHED_FIFO;
+    }
+    static void RunJob(void* arg) { static_cast<BusyWork*>(arg)->Run(); }
+
+    RtWorkerPool pool_;
+    std::vector<BusyWork> jobs_;  // copies of one calibration, one per job
+};
+
+// Batch CannyP3 over every frame of an input_raw clip as one ParallelFor on
+// the experiment's work-stealing runtime (p3_steal.h), or serially on the
+// app thread without one. Each worker owns locked scratch and an edge
+// frame; the edge images are only counted, not written.
+class CannyBatchWorkload : public Workload {
+   public:
+    explicit CannyBatchWorkload(const ThreadSpec& t)
+        : app_id_(t.app_id),
+          mode_(t.canny_mode),
+          raw_(t.input_raw),
+          canny_(CannySelect(t.canny_mode, raw_.rows(), raw_.cols())),
+          runtime_(g_nrt_runtime) {
+        int workers = runtime_ ? runtime_->workers() : 1;
+        if (workers < 1) workers = 1;
+        // Per worker: scratch, then its edge frame, each on its own cache lines
+        size_t scratch = (CannyScratchBytes(raw_.rows(), raw_.cols()) + 63) & ~(size_t)63;
+        size_t frame = ((size_t)raw_.rows() * raw_.cols() + 63) & ~(size_t)63;
+        scratch_bytes_ = scratch + frame;
+        mem_ = AllocLocked(scratch_bytes_ * workers, "canny-batch scratch");
+        buffers_.resize(workers);
+        edges_.resize(workers);
+        edge_pixels_.assign(workers, 0);
+        for (int i = 0; i < workers; i++) {
+            unsigned char* base = static_cast<unsigned char*>(mem_) + scratch_bytes_ * i;
+            CannyBuffersInit(&buffers_[i], raw_.rows(), raw_.cols(), base);
+            edges_[i] = base + scratch;
+        }
+        printf("App #%d canny-batch: %d frames of %dx%d (%s), %d workers\n", t.app_id, raw_.frames(), raw_.cols(),
+               raw_.rows(), CannyModeName(mode_), workers);
+    }
+    ~CannyBatchWorkload() { FreeLocked(mem_, scratch_bytes_ * buffers_.size()); }
+
+    bool Step() {
+        uint64_t start = TimingNowNs();
+        if (runtime_) {
+            runtime_->ParallelFor(raw_.frames(), RunFrame, this);
+        } else {
+            for (int i = 0; i < raw_.frames(); i++) RunFrame(this, i, 0);
+        }
+        elapsed_ns_ += TimingNowNs() - start;
+        frames_ += raw_.frames();
+        MetricsFrame(raw_.frames());
+        return true;
+    }
+    void Teardown() {
+        long pixels = 0;
+        for (long n : edge_pixels_) pixels += n;
+        double sec = elapsed_ns_ * 1e-9;
+        printf("App #%d canny-batch: %ld frames in %.3f s (%.1f fps) on %d workers, %ld edge pixels\n", app_id_,
+               frames_, sec, sec > 0 ? frames_ / sec : 0.0, (int)buffers_.size(), pixels);
+    }
+
+   private:
+    static void RunFrame(void* ctx, size_t index, int worker) {
+        CannyBatchWorkload* self = static_cast<CannyBatchWorkload*>(ctx);
+        const RawFrameSource& raw = self->raw_;
+        unsigned char* edge = self->edges_[worker];
+        self->canny_(raw.frame((int)index), raw.rows(), raw.cols(), 1.0f, 0.2f, 0.6f, edge, &self->buffers_[worker]);
+        long n = 0;
+        for (size_t p = 0, end = (size_t)raw.rows() * raw.cols(); p < end; p++) n += edge[p] == EDGE;
+        self->edge_pixels_[worker] += n;
+    }
+
+    int app_id_;
+    CannyMode mode_;
+    RawFrameSource raw_;
+    CannyFn canny_;  // for the clip's size
+    StealRuntime* runtime_;
+    size_t scratch_bytes_;
+    void* mem_;
+    std::vector<CannyBuffers> buffers_;
+    std::vector<unsigned char*> edges_;
+    std::vector<long> edge_pixels_;  // per worker; summed in Teardown()
+    long frames_ = 0;
+    uint64_t elapsed_ns_ = 0;
+};
+
+class CannyWorkload : public Workload {
+   public:
+    explicit CannyWorkload(const ThreadSpec& t) {
+        CannyOptions options;
+        options.mode = t.canny_mode;
+        options.tiling = t.canny_tiling;
+        options.output = t.edge_output;
+        options.input_raw = t.input_raw;
+        options.camera = t.camera;
+        options.app_id = t.app_id;
+        options.stream = t.stream;
+        options.streams = t.streams;
+        stream_.SetOptions(options);
+    }
+    bool Setup() { return stream_.Open(); }
+    bool Step() { return stream_.ProcessFrame(); }
+    void SetDegraded(bool degraded) { stream_.SetDegraded(degraded); }
+    void Teardown() {
+        printf("\n");  // ends the ">>>" frame line
+        stream_.Close();
+    }
+
+   private:
+    CannyStream stream_;
+};
+
+// STREAM triad a = b + s * c: pure memory bandwidth
+#define STREAM_ELEMENTS (4 << 20)  // 3 x 32 MB of doubles
+
+class MemoryStreamWorkload : public Workload {
+   public:
+    bool Setup() {
+        // Allocated on the app thread; mlockall(MCL_FUTURE) faults it in
+        a_.assign(STREAM_ELEMENTS, 0.0);
+        b_.assign(STREAM_ELEMENTS, 1.0);
+        c_.assign(STREAM_ELEMENTS, 2.0);
+        return true;
+    }
+    bool Step() {
+        double* a = a_.data();
+        const double* b = b_.data();
+        const double* c = c_.data();
+        for (size_t i = 0; i < STREAM_ELEMENTS; i++) a[i] = b[i] + 3.0 * c[i];
+        g_workload_sink = (uint64_t)a[STREAM_ELEMENTS / 2];
+        return true;
+    }
+
+   private:
+    std::vector<double> a_, b_, c_;
+};
+
+// Kernel entry/exit and pipe wakeups, the load a chatty daemon puts on a core
+#define SYSCALLS_PER_STEP 100000
+
+class SyscallHeavyWorkload : public Workload {
+   public:
+    ~SyscallHeavyWorkload() {
+        if (pipe_[0] >= 0) close(pipe_[0]);
+        if (pipe_[1] >= 0) close(pipe_[1]);
+    }
+    bool Setup() {
+        if (pipe(pipe_)) {
+            perror("syscall-heavy: pipe");
+            return false;
+        }
+        return true;
+    }
+    bool Step() {
+        char byte = 0;
+        uint64_t sum = 0;
+        for (int i = 0; i < SYSCALLS_PER_STEP; i++) {
+            // getppid is never cached by glibc, so every call enters the kernel
+            sum += syscall(SYS_getppid);
+            if ((i & 7) == 0) {
+                if (write(pipe_[1], &byte, 1) == 1 && read(pipe_[0], &byte, 1) == 1) sum++;
+            }
+        }
+        g_workload_sink = sum;
+        return true;
+    }
+
+   private:
+    int pipe_[2] = {-1, -1};
+};
+
+// Scattered read-modify-write over 8 MB (4x the Pi 5's 2 MB L3)
+#define THRASH_BYTES (8 << 20)
+#define THRASH_LINE 64
+#define THRASH_STRIDE 40503  // odd, so it visits every line once per pass
+
+class CacheThrashWorkload : public Workload {
+   public:
+    bool Setup() {
+        buf_.assign(THRASH_BYTES, 1);
+        return true;
+    }
+    bool Step() {
+        const size_t lines = THRASH_BYTES / THRASH_LINE;
+        unsigned char* buf = buf_.data();
+        size_t line = 0;
+        for (size_t i = 0; i < lines; i++) {
+            buf[line * THRASH_LINE]++;
+            line = (line + THRASH_STRIDE) & (lines - 1);
+        }
+        g_workload_sink = buf[0];
+        return true;
+    }
+
+   private:
+    std::vector<unsigned char> buf_;
+};
+
+// Process creation: each fork copies the (locked, populated) parent's page
+// tables, and exec tears them down again
+#define FORKS_PER_STEP 20
+#define FORK_EXEC_PATH "/bin/true"
+
+class ForkExecWorkload : public Workload {
+   public:
+    bool Setup() {
+        if (access(FORK_EXEC_PATH, X_OK)) {
+            perror("fork-exec: " FORK_EXEC_PATH);
+            return false;
+        }
+        return true;
+    }
+    bool Step() {
+        for (int i = 0; i < FORKS_PER_STEP; i++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                execl(FORK_EXEC_PATH, FORK_EXEC_PATH, (char*)NULL);
+                _exit(127);
+            }
+            if (pid < 0) {
+                perror("fork-exec: fork");
+                return false;
+            }
+            int status;
+            waitpid(pid, &status, 0);
+        }
+        return true;
+    }
+};
+
+// Block I/O: write a scratch file, force it out, evict it from the page
+// cache and read it back, so every pass reaches the device
+#define FILE_IO_BYTES (4 << 20)
+#define FILE_IO_BLOCK (64 << 10)
+
+class FileIoWorkload : public Workload {
+   public:
+    ~FileIoWorkload() {
+        if (fd_ >= 0) close(fd_);
+    }
+    bool Setup() {
+        // Unlinked at once, so the file disappears even if the run is killed
+        char path[] = "p3_stress_XXXXXX";
+        fd_ = mkstemp(path);
+        if (fd_ < 0) {
+            perror("file-io: mkstemp");
+            return false;
+        }
+        unlink(path);
+        block_.assign(FILE_IO_BLOCK, 0x5a);
+        return true;
+    }
+    bool Step() {
+        for (off_t off = 0; off < FILE_IO_BYTES; off += FILE_IO_BLOCK) {
+            if (pwrite(fd_, block_.data(), FILE_IO_BLOCK, off) != FILE_IO_BLOCK) {
+                perror("file-io: pwrite");
+                return false;
+            }
+        }
+        fdatasync(fd_);
+        posix_fadvise(fd_, 0, FILE_IO_BYTES, POSIX_FADV_DONTNEED);
+        uint64_t sum = 0;
+        for (off_t off = 0; off < FILE_IO_BYTES; off += FILE_IO_BLOCK) {
+            if (pread(fd_, block_.data(), FILE_IO_BLOCK, off) != FILE_IO_BLOCK) {
+                perror("file-io: pread");
+                return false;
+            }
+            sum += block_[0];
+        }
+        g_workload_sink = sum;
+        return true;
+    }
+
+   private:
+    int fd_ = -1;
+    std::vector<unsigned char> block_;
+};
+
+// Loopback TCP: both ends live on this thread, so each chunk is one
+// send + one receive through the full network stack and its softirqs
+#define NET_CHUNK (64 << 10)  // below the default loopback socket buffers
+#define NET_CHUNKS_PER_STEP 16
+
+class NetLoopbackWorkload : public Workload {
+   public:
+    ~NetLoopbackWorkload() {
+        for (int fd : {listen_, client_, server_}) {
+            if (fd >= 0) close(fd);
+        }
+    }
+    bool Setup() {
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        listen_ = socket(AF_INET, SOCK_STREAM, 0);
+        client_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_ < 0 || client_ < 0 || bind(listen_, (struct sockaddr*)&addr, len) ||
+            getsockname(listen_, (struct sockaddr*)&addr, &len) || listen(listen_, 1) ||
+            connect(client_, (struct sockaddr*)&addr, len) || (server_ = accept(listen_, NULL, NULL)) < 0) {
+            perror("net-loopback: socket setup");
+            return false;
+        }
+        int one = 1;
+        setsockopt(client_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        chunk_.assign(NET_CHUNK, 0x5a);
+        return true;
+    }
+    bool Step() {
+        for (int i = 0; i < NET_CHUNKS_PER_STEP; i++) {
+            if (send(client_, chunk_.data(), NET_CHUNK, 0) != NET_CHUNK ||
+                recv(server_, chunk_.data(), NET_CHUNK, MSG_WAITALL) != NET_CHUNK) {
+                perror("net-loopback: send/recv");
+                return false;
+            }
+        }
+        return true;
+    }
+
+   private:
+    int listen_ = -1, client_ = -1, server_ = -1;
+    std::vector<unsigned char> chunk_;
+};
+
+// hrtimer load: every sleep arms a timer, takes its interrupt and wakes
+#define TIMER_SLEEPS_PER_STEP 1000
+#define TIMER_SLEEP_NS 50000
+
+class TimerStormWorkload : public Workload {
+   public:
+    bool Step() {
+        struct timespec ts = {0, TIMER_SLEEP_NS};
+        for (int i = 0; i < TIMER_SLEEPS_PER_STEP; i++) clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+        return true;
+    }
+};
+
+template <typename T>
+static Workload* Make(const ThreadSpec&) {
+    return new T();
+}
+
+static Workload* MakeBusyCal(const ThreadSpec& spec) { return new BusyCalWorkload(spec); }
+static Workload* MakeSharedLock(const ThreadSpec& spec) { return new SharedLockWorkload(spec); }
+static Workload* MakePoolJobs(const ThreadSpec& spec) { return new PoolJobsWorkload(spec); }
+static Workload* MakeCanny(const ThreadSpec& spec) { return new CannyWorkload(spec); }
+static Workload* MakeCannyBatch(const ThreadSpec& spec) { return new CannyBatchWorkload(spec); }
+
+// Unpaced unit counts keep each interference run in the seconds range
+static const WorkloadInfo kWorkloads[] = {
+    {"busycal", 1, MakeBusyCal},
+    {"canny", 0, MakeCanny},
+    {"memory-stream", 300, Make<MemoryStreamWorkload>},
+    {"syscall-heavy", 100, Make<SyscallHeavyWorkload>},
+    {"cache-thrash", 3000, Make<CacheThrashWorkload>},
+    {"shared-lock", 1000, MakeSharedLock},
+    {"fork-exec", 50, Make<ForkExecWorkload>},
+    {"file-io", 50, Make<FileIoWorkload>},
+    {"net-loopback", 200, Make<NetLoopbackWorkload>},
+    {"timer-storm", 100, Make<TimerStormWorkload>},
+    {"pool-jobs", 1000, MakePoolJobs},
+    {"canny-batch", 1, MakeCannyBatch},
+};
+
+const WorkloadInfo* FindWorkload(const std::string& name) {
+    for (const WorkloadInfo& info : kWorkloads) {
+        if (name == info.name) return &info;
+    }
+    return NULL;
+}
+
+std::string WorkloadNames() {
+    std::string names;
+    for (const WorkloadInfo& info : kWorkloads) {
+        if (!names.empty()) names += " | ";
+        names += info.name;
+    }
+    return names;
+}
+
+std::unique_ptr<Workload> MakeWorkload(const ThreadSpec& spec) {
+    const WorkloadInfo* info = FindWorkload(spec.workload);
+    if (!info) throw std::runtime_error{"unknown workload '" + spec.workload + "'"};
+    return std::unique_ptr<Workload>(info->make(spec));
+}
+
+bool RunWorkload(Workload* workload, int units) {
+    if (!workload->Setup()) return false;
+    for (int i = 0; units == 0 || i < units; i++) {
+        if (!workload->Step()) break;
+    }
+    workload->Teardown();
+    return true;
+}
@@ -0,0 +1,77 @@
+/**
+ * Pluggable per-thread workloads.
+ *
+ * A Workload is driven one unit at a time: Setup() once on the app's own
+ * thread, Step() per unit (one frame, one pass), Teardown() once at the
+ * end. Periodic apps call Step() once per release; unpaced apps call it
+ * `run_units` times from RunWorkload(). Workloads are built by name from
+ * the registry, so `workload = <name>` in an experiment selects one
+ * without touching the app classes.
+ *
+ *   busycal       - calibrated BusyWork units (p3_busycal.h)
+ *   canny         - CannyP3, one frame per step
+ *   memory-stream - STREAM triad over arrays far larger than the caches
+ *   syscall-heavy - tight loop of cheap system calls and pipe round trips
+ *   cache-thrash  - dirties every line of a buffer 4x the L3, in a
+ *                   scattered order the prefetcher cannot follow
+ *   shared-lock   - BusyWork units inside a mutex shared with other apps
+ *                   (`lock`, p3_sync.h); reports the time spent blocked
+ *   fork-exec     - fork() + exec of /bin/true: page-table copies, TLB
+ *                   shootdowns and process creation in the kernel. Each
+ *                   fork also turns this process's memory copy-on-write,
+ *                   so even mlock'ed RT apps take minor faults
+ *   file-io       - write, fdatasync, drop from the page cache and read
+ *                   back an unlinked scratch file: block I/O interrupts
+ *   net-loopback  - TCP round trips over 127.0.0.1: softirq network stack
+ *   timer-storm   - back-to-back 50us sleeps: a stream of hrtimer
+ *                   interrupts and wakeups
+ *   pool-jobs     - fans pool_jobs BusyWork jobs out to a persistent RT
+ *                   worker pool (p3_workerpool.h) and waits for them
+ *   canny-batch   - CannyP3 over every frame of input_raw in one Step, as
+ *                   parallel tasks on the NRT work-stealing runtime
+ *                   (p3_steal.h, [experiment] steal_workers)
+ *
+ * The last four (and memory-stream) are meant as `class = stress` apps,
+ * which repeat Step() for the whole measurement window.
+ */
+#ifndef P3_WORKLOAD_H
+#define P3_WORKLOAD_H
+
+#include <memory>
+#include <string>
+
+#include "p3_experiment.h"
+
+class Workload {
+   public:
+    virtual ~Workload() {}
+
+    virtual bool Setup() { return true; }
+    // One unit of work; false once the workload has nothing left to do
+    virtual bool Step() = 0;
+    virtual void Teardown() {}
+    // Overload mode for periodic apps (`overrun = degrade`): cheaper Steps
+    // until called again with false. Default: no cheaper mode.
+    virtual void SetDegraded(bool /*degraded*/) {}
+};
+
+struct WorkloadInfo {
+    const char* name;
+    int run_units;  // Steps of an unpaced run; 0 = until Step() returns false
+    Workload* (*make)(const ThreadSpec& spec);
+};
+
+// NULL if no workload has that name
+const WorkloadInfo* FindWorkload(const std::string& name);
+
+// "busycal | canny | ..." for usage and parse errors
+std::string WorkloadNames();
+
+// Throws std::runtime_error for an unknown name
+std::unique_ptr<Workload> MakeWorkload(const ThreadSpec& spec);
+
+// Unpaced run: Setup(), `units` Steps (0 = until done), Teardown();
+// false if Setup() failed
+bool RunWorkload(Workload* workload, int units);
+
+#endif